@@ -0,0 +1,96 @@
+/* fsbench.c
+
+   Measures how far file system operations on unrelated files run in
+   parallel.  One child reads a file larger than the buffer cache from
+   start to end, so that it keeps going to the disk, while another
+   reads a small file that stays cached over and over until the first
+   is done.  A kernel that serialises the file system on one lock
+   makes every cached read wait for a disk read; one that locks per
+   inode lets them through.  Run it with read-ahead off ("-ra=0") and
+   compare the number of cached reads it reports between kernels. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+#define COLD_SIZE (256 * 1024)  /* Four times the buffer cache. */
+#define HOT_SIZE 512
+#define CHUNK 512
+
+static char buf[CHUNK];
+
+/* Creates NAME with SIZE bytes, exiting on failure. */
+static void
+make_file (const char *name, int size)
+{
+  int fd, ofs;
+
+  if (!create (name, size) || (fd = open (name)) < 0)
+    {
+      printf ("fsbench: cannot create %s\n", name);
+      exit (EXIT_FAILURE);
+    }
+  for (ofs = 0; ofs < size; ofs += CHUNK)
+    write (fd, buf, CHUNK);
+  close (fd);
+}
+
+/* Reads "cold" through once, then creates "done". */
+static void
+read_cold (void)
+{
+  int fd = open ("cold");
+  while (read (fd, buf, CHUNK) == CHUNK)
+    continue;
+  close (fd);
+  create ("done", 0);
+}
+
+/* Reads "hot" until "done" appears and reports how many times. */
+static void
+read_hot (void)
+{
+  int fd = open ("hot");
+  int done, reads = 0;
+
+  while ((done = open ("done")) < 0)
+    {
+      seek (fd, 0);
+      read (fd, buf, CHUNK);
+      reads++;
+    }
+  close (done);
+  close (fd);
+  printf ("fsbench: %d cached reads during %d kB of disk reads\n",
+          reads, COLD_SIZE / 1024);
+}
+
+int
+main (void)
+{
+  pid_t cold, hot;
+
+  remove ("done");
+  make_file ("cold", COLD_SIZE);
+  make_file ("hot", HOT_SIZE);
+
+  cold = fork ();
+  if (cold == 0)
+    {
+      read_cold ();
+      return EXIT_SUCCESS;
+    }
+  hot = fork ();
+  if (hot == 0)
+    {
+      read_hot ();
+      return EXIT_SUCCESS;
+    }
+
+  wait (cold);
+  wait (hot);
+  remove ("cold");
+  remove ("hot");
+  remove ("done");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+/* readbench.c
+
+   Measures system call overhead on large buffers by reading FILE
+   into a 64 kB buffer ITERATIONS times.  With a small FILE the time
+   goes mostly to validating and pinning the buffer.  Run it alone
+   and compare the "Timer: N ticks" line printed at shutdown between
+   kernels. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+#define BUF_SIZE (64 * 1024)
+
+static char buf[BUF_SIZE];
+
+int
+main (int argc, char *argv[]) 
+{
+  struct vm_stats stats;
+  int iterations = 1000;
+  int fd, i;
+  long long total = 0;
+
+  if (argc != 2 && argc != 3) 
+    {
+      printf ("usage: readbench FILE [ITERATIONS]\n");
+      return EXIT_FAILURE;
+    }
+  if (argc == 3)
+    iterations = atoi (argv[2]);
+
+  fd = open (argv[1]);
+  if (fd < 0) 
+    {
+      printf ("%s: open failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < iterations; i++) 
+    {
+      seek (fd, 0);
+      total += read (fd, buf, sizeof buf);
+    }
+  close (fd);
+
+  vmstat (&stats);
+  printf ("readbench: %d reads, %lld bytes, %u minor and %u major faults\n",
+          iterations, total, stats.minor_faults, stats.major_faults);
+  return EXIT_SUCCESS;
+}
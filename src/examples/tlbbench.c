@@ -0,0 +1,52 @@
+/* tlbbench.c
+
+   Measures TLB reach by touching one word in every page of an 8 MB
+   array, PASSES times over.  The array always contains a 4 MB aligned
+   region, which a kernel run with -large-pages maps with a single
+   4 MB page once every page of it has been written.  Run it alone
+   with enough memory for the whole array (e.g. "pintos -m 64") and
+   compare the "Timer: N ticks" line printed at shutdown with and
+   without -large-pages, together with the "Large pages" line. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+#define ARRAY_SIZE (8 * 1024 * 1024)
+#define PAGE_SIZE 4096
+
+static char array[ARRAY_SIZE];
+
+int
+main (int argc, char *argv[]) 
+{
+  struct vm_stats stats;
+  int passes = 100;
+  unsigned sum = 0;
+  int pass, i;
+
+  if (argc > 2) 
+    {
+      printf ("usage: tlbbench [PASSES]\n");
+      return EXIT_FAILURE;
+    }
+  if (argc == 2)
+    passes = atoi (argv[1]);
+
+  /* Write every page, so none of them stays on the zero page. */
+  for (i = 0; i < ARRAY_SIZE; i += PAGE_SIZE)
+    array[i] = i / PAGE_SIZE;
+
+  /* Vary the offset within the page so the cache sees a new line on
+     every pass while the TLB sees the same pages. */
+  for (pass = 0; pass < passes; pass++)
+    for (i = (pass * 64) % PAGE_SIZE; i < ARRAY_SIZE; i += PAGE_SIZE)
+      sum += array[i];
+
+  vmstat (&stats);
+  printf ("tlbbench: %d passes over %d pages, sum %u, "
+          "%u minor and %u major faults\n",
+          passes, ARRAY_SIZE / PAGE_SIZE, sum, stats.minor_faults,
+          stats.major_faults);
+  return EXIT_SUCCESS;
+}
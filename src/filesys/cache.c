@@ -0,0 +1,353 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache of file system sectors.
+
+   All file system I/O goes through a fixed set of CACHE_SIZE
+   sector buffers, replaced by the clock algorithm.  Writes only
+   dirty a buffer; the data reaches the disk when the buffer is
+   evicted, when the flush thread wakes up every FLUSH_INTERVAL
+   ticks, or when cache_flush() is called at shutdown.
+
+   cache_lock protects the mapping from sectors to buffers, that
+   is, each buffer's SECTOR, PIN_CNT and ACCESSED members, and the
+   clock hand.  Each buffer's own lock protects its contents.  A
+   buffer is pinned by everyone who uses it and only locked while
+   pinned, so an unpinned buffer is never locked and may be
+   reassigned to another sector while holding cache_lock alone.
+
+   cache_readahead() queues a sector for the read-ahead thread,
+   which brings it into the cache while the caller goes on
+   running, so a sequential reader usually finds its next
+   sectors already there. */
+
+/* Number of buffers in the cache. */
+#define CACHE_SIZE 64
+
+/* Timer ticks between runs of the flush thread. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* Most sectors waiting for the read-ahead thread. */
+#define READAHEAD_QUEUE 64
+
+/* SECTOR of a buffer that holds no sector. */
+#define SECTOR_NONE ((block_sector_t) -1)
+
+/* A cached sector. */
+struct cache_block
+  {
+    block_sector_t sector;              /* Sector held, or SECTOR_NONE. */
+    int pin_cnt;                        /* Number of users. */
+    bool accessed;                      /* Used since the clock passed? */
+    struct lock lock;                   /* Protects the members below. */
+    bool valid;                         /* DATA read from disk yet? */
+    bool dirty;                         /* DATA newer than the disk? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_block cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signalled when pins drop. */
+static size_t clock_hand;
+
+/* Sectors waiting to be read ahead, a ring of RA_CNT entries
+   starting at RA_HEAD.  Protected by ra_lock. */
+static block_sector_t ra_queue[READAHEAD_QUEUE];
+static size_t ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_queued;      /* Signalled on each request. */
+
+/* Statistics. */
+static unsigned long long hit_cnt;      /* Lookups found in the cache. */
+static unsigned long long miss_cnt;     /* Lookups that took a buffer. */
+static unsigned long long write_cnt;    /* Dirty buffers written back. */
+static unsigned long long readahead_cnt; /* Sectors read ahead. */
+static unsigned long long drop_cnt;     /* Read-aheads dropped, queue full. */
+
+static void flush_thread (void *aux);
+static void readahead_thread (void *aux);
+
+/* Initializes the buffer cache and starts its flush and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].sector = SECTOR_NONE;
+      lock_init (&cache[i].lock);
+    }
+  lock_init (&ra_lock);
+  cond_init (&ra_queued);
+  thread_create ("flusher", PRI_DEFAULT, flush_thread, NULL);
+  thread_create ("readahead", PRI_DEFAULT, readahead_thread, NULL);
+}
+
+/* Returns the buffer holding SECTOR, or a null pointer if it is
+   not cached.  Must be called with cache_lock held. */
+static struct cache_block *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Advances the clock hand to an unpinned buffer that is empty or
+   has not been used since the hand last passed it, and returns
+   it.  Returns a null pointer if every buffer is pinned.  Must be
+   called with cache_lock held. */
+static struct cache_block *
+choose_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_block *b = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (b->pin_cnt > 0)
+        continue;
+      if (b->sector == SECTOR_NONE || !b->accessed)
+        return b;
+      b->accessed = false;
+    }
+  return NULL;
+}
+
+/* Writes B back to disk if it is dirty.  B must be locked. */
+static void
+write_back (struct cache_block *b)
+{
+  if (b->valid && b->dirty)
+    {
+      block_write (fs_device, b->sector, b->data);
+      b->dirty = false;
+      write_cnt++;
+    }
+}
+
+/* Returns the buffer for SECTOR, pinned and locked.  Unless FILL
+   is false, because the caller is about to overwrite the whole
+   sector, the buffer's data is read from disk if needed.
+   For READAHEAD, returns a null pointer instead if SECTOR is
+   already cached. */
+static struct cache_block *
+cache_get (block_sector_t sector, bool fill, bool readahead)
+{
+  struct cache_block *b;
+
+  ASSERT (sector != SECTOR_NONE);
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      b = lookup (sector);
+      if (b != NULL)
+        {
+          if (readahead)
+            {
+              lock_release (&cache_lock);
+              return NULL;
+            }
+          hit_cnt++;
+          break;
+        }
+
+      b = choose_victim ();
+      if (b == NULL)
+        {
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+      if (!b->dirty)
+        {
+          b->sector = sector;
+          b->valid = false;
+          if (readahead)
+            readahead_cnt++;
+          else
+            miss_cnt++;
+          break;
+        }
+
+      /* Write the victim back without holding cache_lock, then
+         look again, since another thread may have brought SECTOR
+         in or dirtied the victim in the meantime. */
+      b->pin_cnt++;
+      lock_release (&cache_lock);
+      lock_acquire (&b->lock);
+      write_back (b);
+      lock_release (&b->lock);
+      lock_acquire (&cache_lock);
+      if (--b->pin_cnt == 0)
+        cond_signal (&cache_unpinned, &cache_lock);
+    }
+  b->pin_cnt++;
+  b->accessed = true;
+  lock_release (&cache_lock);
+
+  lock_acquire (&b->lock);
+  if (!b->valid)
+    {
+      if (fill)
+        block_read (fs_device, sector, b->data);
+      b->valid = true;
+    }
+  return b;
+}
+
+/* Unlocks and unpins B, which was returned by cache_get(). */
+static void
+cache_put (struct cache_block *b)
+{
+  lock_release (&b->lock);
+  lock_acquire (&cache_lock);
+  if (--b->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS of sector SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_get (sector, true, false);
+  memcpy (buffer, b->data + ofs, size);
+  cache_put (b);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER to sector SECTOR, starting at
+   byte OFS.  The rest of the sector keeps its contents. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_get (sector, size < BLOCK_SECTOR_SIZE, false);
+  memcpy (b->data + ofs, buffer, size);
+  b->dirty = true;
+  cache_put (b);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+   Only a hint: it is dropped if too many requests are waiting. */
+void
+cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&ra_lock);
+  if (ra_cnt < READAHEAD_QUEUE)
+    {
+      ra_queue[(ra_head + ra_cnt++) % READAHEAD_QUEUE] = sector;
+      cond_signal (&ra_queued, &ra_lock);
+    }
+  else
+    drop_cnt++;
+  lock_release (&ra_lock);
+}
+
+/* Body of the read-ahead thread, which reads the sectors queued
+   by cache_readahead() into the cache in order. */
+static void
+readahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      struct cache_block *b;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_queued, &ra_lock);
+      sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % READAHEAD_QUEUE;
+      ra_cnt--;
+      lock_release (&ra_lock);
+
+      b = cache_get (sector, true, true);
+      if (b != NULL)
+        cache_put (b);
+    }
+}
+
+/* Writes every dirty buffer back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_block *b = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (b->sector == SECTOR_NONE)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      b->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&b->lock);
+      write_back (b);
+      cache_put (b);
+    }
+}
+
+/* Body of the flush thread, which writes dirty buffers behind
+   every FLUSH_INTERVAL ticks so that a crash loses at most that
+   much work. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %llu hits, %llu misses, %llu write-backs, "
+          "%llu read ahead, %llu read-aheads dropped\n",
+          hit_cnt, miss_cnt, write_cnt, readahead_cnt, drop_cnt);
+}
@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -21,6 +24,169 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Cache of a directory's entries by name, which hangs off the
+   directory's inode so that every opener shares it.  Each entry
+   holds what lookup() found for a name: the sector of the file's
+   inode and the offset of its directory entry, or that no entry
+   has that name.  dir_add() and dir_remove() drop the entry for
+   the name they change.  The cache goes away with the inode's
+   last opener; filesys.c keeps the root directory open, so its
+   cache lasts until shutdown. */
+struct dir_cache
+  {
+    struct lock lock;                   /* Protects ENTRIES. */
+    struct hash entries;                /* Cached names. */
+  };
+
+/* A cached name. */
+struct dcache_entry
+  {
+    struct hash_elem elem;              /* Element in dir_cache. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    bool present;                       /* False if NAME is not there. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Offset of directory entry. */
+  };
+
+/* Most names cached per directory.  A full cache is emptied, so
+   lookups of many names that don't exist can't use up memory. */
+#define DIR_CACHE_MAX 64
+
+/* Statistics, updated with interrupts off since each cache has its
+   own lock. */
+static unsigned long long dcache_hit_cnt;   /* Names found cached. */
+static unsigned long long dcache_miss_cnt;  /* Names read from disk. */
+
+static unsigned
+dcache_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct dcache_entry, elem)->name);
+}
+
+static bool
+dcache_less_func (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct dcache_entry, elem)->name,
+                 hash_entry (b, struct dcache_entry, elem)->name) < 0;
+}
+
+static void
+dcache_free_entry (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct dcache_entry, elem));
+}
+
+/* Gives INODE a name cache if it doesn't have one.  Leaves it
+   without one if memory is short. */
+static void
+dir_cache_attach (struct inode *inode)
+{
+  struct dir_cache *cache;
+
+  inode_lock_dir (inode, true);
+  if (inode_get_dir_cache (inode) == NULL)
+    {
+      cache = malloc (sizeof *cache);
+      if (cache != NULL
+          && hash_init (&cache->entries, dcache_hash_func,
+                        dcache_less_func, NULL))
+        {
+          lock_init (&cache->lock);
+          inode_set_dir_cache (inode, cache);
+        }
+      else
+        free (cache);
+    }
+  inode_unlock_dir (inode, true);
+}
+
+/* Frees CACHE.  Called by inode_close() for the last closer of
+   the directory's inode. */
+void
+dir_cache_destroy (struct dir_cache *cache)
+{
+  hash_destroy (&cache->entries, dcache_free_entry);
+  free (cache);
+}
+
+/* Looks up NAME in DIR's name cache.  If it is there, copies its
+   entry to *EP and returns true. */
+static bool
+dcache_find (const struct dir *dir, const char *name,
+             struct dcache_entry *ep)
+{
+  struct dir_cache *cache = inode_get_dir_cache (dir->inode);
+  struct hash_elem *e;
+  enum intr_level old_level;
+
+  if (cache == NULL)
+    return false;
+
+  strlcpy (ep->name, name, sizeof ep->name);
+  lock_acquire (&cache->lock);
+  e = hash_find (&cache->entries, &ep->elem);
+  if (e != NULL)
+    *ep = *hash_entry (e, struct dcache_entry, elem);
+  lock_release (&cache->lock);
+
+  old_level = intr_disable ();
+  if (e != NULL)
+    dcache_hit_cnt++;
+  else
+    dcache_miss_cnt++;
+  intr_set_level (old_level);
+  return e != NULL;
+}
+
+/* Records in DIR's name cache that NAME is at offset OFS with its
+   inode in INODE_SECTOR, or that it is absent if not PRESENT.
+   Silently does nothing if memory is short. */
+static void
+dcache_store (const struct dir *dir, const char *name, bool present,
+              block_sector_t inode_sector, off_t ofs)
+{
+  struct dir_cache *cache = inode_get_dir_cache (dir->inode);
+  struct dcache_entry *entry;
+  struct hash_elem *old;
+
+  if (cache == NULL)
+    return;
+  entry = malloc (sizeof *entry);
+  if (entry == NULL)
+    return;
+  strlcpy (entry->name, name, sizeof entry->name);
+  entry->present = present;
+  entry->inode_sector = inode_sector;
+  entry->ofs = ofs;
+
+  lock_acquire (&cache->lock);
+  if (hash_size (&cache->entries) >= DIR_CACHE_MAX)
+    hash_clear (&cache->entries, dcache_free_entry);
+  old = hash_replace (&cache->entries, &entry->elem);
+  lock_release (&cache->lock);
+  if (old != NULL)
+    dcache_free_entry (old, NULL);
+}
+
+/* Drops NAME from DIR's name cache. */
+static void
+dcache_drop (const struct dir *dir, const char *name)
+{
+  struct dir_cache *cache = inode_get_dir_cache (dir->inode);
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (cache == NULL)
+    return;
+  strlcpy (key.name, name, sizeof key.name);
+  lock_acquire (&cache->lock);
+  e = hash_delete (&cache->entries, &key.elem);
+  lock_release (&cache->lock);
+  if (e != NULL)
+    dcache_free_entry (e, NULL);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -39,6 +205,8 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      if (inode_get_dir_cache (inode) == NULL)
+        dir_cache_attach (inode);
       return dir;
     }
   else
@@ -87,27 +255,53 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   DIR's entries must be locked. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dcache_entry cached;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  /* Try the name cache first. */
+  if (dcache_find (dir, name, &cached))
+    {
+      if (!cached.present)
+        return false;
+      if (ep != NULL)
+        {
+          /* Callers may write *EP back to disk, so leave no stack
+             garbage in the parts the cache doesn't know. */
+          memset (ep, 0, sizeof *ep);
+          ep->inode_sector = cached.inode_sector;
+          strlcpy (ep->name, name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = cached.ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
       {
+        dcache_store (dir, name, true, e.inode_sector, ofs);
         if (ep != NULL)
           *ep = e;
         if (ofsp != NULL)
           *ofsp = ofs;
         return true;
       }
+  dcache_store (dir, name, false, 0, 0);
   return false;
 }
 
@@ -124,10 +318,12 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock_dir (dir->inode, false);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  inode_unlock_dir (dir->inode, false);
 
   return *inode != NULL;
 }
@@ -153,6 +349,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
     return false;
 
   /* Check that NAME is not in use. */
+  inode_lock_dir (dir->inode, true);
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
@@ -173,8 +370,10 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  dcache_drop (dir, name);
 
  done:
+  inode_unlock_dir (dir->inode, true);
   return success;
 }
 
@@ -193,6 +392,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock_dir (dir->inode, true);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -203,6 +403,7 @@ dir_remove (struct dir *dir, const char *name)
 
   /* Erase directory entry. */
   e.in_use = false;
+  dcache_drop (dir, name);
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
@@ -211,6 +412,7 @@ dir_remove (struct dir *dir, const char *name)
   success = true;
 
  done:
+  inode_unlock_dir (dir->inode, true);
   inode_close (inode);
   return success;
 }
@@ -222,15 +424,27 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  inode_lock_dir (dir->inode, false);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock_dir (dir->inode, false);
+  return found;
+}
+
+/* Prints name cache statistics. */
+void
+dir_print_stats (void)
+{
+  printf ("Directory name cache: %llu hits, %llu misses\n",
+          dcache_hit_cnt, dcache_miss_cnt);
 }
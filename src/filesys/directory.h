@@ -12,6 +12,7 @@
 #define NAME_MAX 14
 
 struct inode;
+struct dir_cache;
 
 /* Opening and closing directories. */
 bool dir_create (block_sector_t sector, size_t entry_cnt);
@@ -27,4 +28,8 @@ bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
 
+/* Name lookup cache. */
+void dir_cache_destroy (struct dir_cache *);
+void dir_print_stats (void);
+
 #endif /* filesys/directory.h */
@@ -1,5 +1,6 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -9,8 +10,20 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_end;               /* End of the read-ahead queued so far. */
+    int ra_window;              /* Sectors to read ahead, 0 if none. */
   };
 
+/* Read-ahead window of a sequential reader, in sectors.  The
+   window starts at READAHEAD_MIN and doubles on each sequential
+   read up to file_readahead_max, which -ra sets.  A seek closes
+   it again. */
+#define READAHEAD_MIN 2
+#define READAHEAD_DEFAULT_MAX 32
+
+int file_readahead_max = READAHEAD_DEFAULT_MAX;
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -60,6 +73,38 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* Notes a read of SIZE bytes at OFS in FILE and, if FILE is being
+   read sequentially, queues read-ahead of its window past the
+   read. */
+static void
+readahead (struct file *file, off_t ofs, off_t size)
+{
+  off_t start, end;
+
+  if (ofs != file->ra_next)
+    {
+      /* A seek.  Read-ahead resumes if reading goes on from here. */
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
+  else if (file->ra_window == 0)
+    file->ra_window = (file_readahead_max < READAHEAD_MIN
+                       ? file_readahead_max : READAHEAD_MIN);
+  else if (file->ra_window * 2 <= file_readahead_max)
+    file->ra_window *= 2;
+  file->ra_next = ofs + size;
+
+  if (file->ra_window == 0 || file_readahead_max == 0)
+    return;
+  start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+  end = file->ra_next + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (start < end)
+    {
+      inode_readahead (file->inode, start, end);
+      file->ra_end = end;
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -69,6 +114,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  readahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
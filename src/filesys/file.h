@@ -6,6 +6,10 @@
 
 struct inode;
 
+/* Largest read-ahead window in sectors, set by -ra.  0 turns
+   read-ahead off. */
+extern int file_readahead_max;
+
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
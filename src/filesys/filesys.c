@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -10,6 +11,11 @@
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Kept open from filesys_init() to filesys_done(), so that the
+   root directory's inode, and with it its name cache, outlives
+   the opens and closes of each file system call. */
+static struct dir *root_dir;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -19,11 +25,10 @@ filesys_init (bool format)
 {
   fs_device = block_get_role (BLOCK_FILESYS);
 
-  lock_init(&filesys_lock);
-
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
   free_map_init ();
 
@@ -31,6 +36,10 @@ filesys_init (bool format)
     do_format ();
 
   free_map_open ();
+
+  root_dir = dir_open_root ();
+  if (root_dir == NULL)
+    PANIC ("can't open root directory");
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -38,7 +47,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  dir_close (root_dir);
   free_map_close ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
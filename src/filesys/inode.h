@@ -6,6 +6,7 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct dir_cache;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
@@ -15,9 +16,14 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_readahead (const struct inode *, off_t start, off_t end);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_lock_dir (struct inode *, bool exclusive);
+void inode_unlock_dir (struct inode *, bool exclusive);
+struct dir_cache *inode_get_dir_cache (struct inode *);
+void inode_set_dir_cache (struct inode *, struct dir_cache *);
 
 #endif /* filesys/inode.h */
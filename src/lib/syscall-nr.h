@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Clone this process copy-on-write. */
+    SYS_MADVISE,                /* Give paging hints for a range. */
+    SYS_VMSTAT,                 /* Report this process's paging activity. */
+    SYS_MSYNC                   /* Write a memory mapping back to its file. */
   };
 
 #endif /* lib/syscall-nr.h */
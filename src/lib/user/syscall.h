@@ -12,6 +12,25 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Hints for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_SEQUENTIAL 1       /* Read ahead, drop what was read. */
+#define MADV_RANDOM 2           /* No read-ahead. */
+#define MADV_WILLNEED 3         /* Will be used soon, page in now. */
+#define MADV_DONTNEED 4         /* Not needed, free now. */
+
+/* Paging activity of a process, filled in by vmstat(). */
+struct vm_stats
+  {
+    unsigned minor_faults;      /* Pages mapped without I/O. */
+    unsigned major_faults;      /* Pages read from a file or swap. */
+    unsigned evicted;           /* Pages of this process evicted. */
+    unsigned stolen;            /* Frames it evicted from others. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned pin_waits;         /* Waits with every frame pinned. */
+  };
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -45,4 +64,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+bool madvise (void *addr, unsigned length, int advice);
+void vmstat (struct vm_stats *);
+void msync (mapid_t);
+
 #endif /* lib/user/syscall.h */
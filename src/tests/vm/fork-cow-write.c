@@ -0,0 +1,66 @@
+/* Forks a child while a buffer is shared copy-on-write between it
+   and its parent, then has both processes write() the buffer,
+   still shared, to a file over and over while each sweeps a large
+   array to push the other's pages out.  Every write() pins the
+   buffer's frames, so one process unpinning them at the end of
+   its write must not leave them unpinned for the other.  Both
+   files must end up holding the buffer. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+#define BIG_SIZE (2 * 1024 * 1024)
+#define ROUNDS 8
+
+static char buf[SIZE];
+static char big[BIG_SIZE];
+
+/* Writes BUF to FILE_NAME ROUNDS times, sweeping BIG before each
+   write. */
+static void
+write_rounds (const char *file_name)
+{
+  int fd, i;
+
+  fd = open (file_name);
+  if (fd < 2)
+    fail ("open \"%s\"", file_name);
+  for (i = 0; i < ROUNDS; i++)
+    {
+      memset (big, i, sizeof big);
+      seek (fd, 0);
+      if (write (fd, buf, SIZE) != SIZE)
+        fail ("write \"%s\" round %d", file_name, i);
+    }
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  msg ("fill buffer");
+  memset (buf, 0x5a, sizeof buf);
+  CHECK (create ("parent-out", SIZE), "create \"parent-out\"");
+  CHECK (create ("child-out", SIZE), "create \"child-out\"");
+
+  msg ("fork");
+  child = fork ();
+  if (child == 0)
+    {
+      write_rounds ("child-out");
+      exit (0x42);
+    }
+  CHECK (child != PID_ERROR, "fork returned a child");
+
+  msg ("write from parent");
+  write_rounds ("parent-out");
+  CHECK (wait (child) == 0x42, "wait for child");
+
+  check_file ("parent-out", buf, SIZE);
+  check_file ("child-out", buf, SIZE);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow-write) begin
+(fork-cow-write) fill buffer
+(fork-cow-write) create "parent-out"
+(fork-cow-write) create "child-out"
+(fork-cow-write) fork
+(fork-cow-write) fork returned a child
+(fork-cow-write) write from parent
+(fork-cow-write) wait for child
+(fork-cow-write) open "parent-out" for verification
+(fork-cow-write) verified contents of "parent-out"
+(fork-cow-write) close "parent-out"
+(fork-cow-write) open "child-out" for verification
+(fork-cow-write) verified contents of "child-out"
+(fork-cow-write) close "child-out"
+(fork-cow-write) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Forks a child that checks it sees the data its parent wrote
+   before the fork, even as the parent overwrites it, and then
+   overwrites its own copy.  The parent checks that the child's
+   writes did not reach it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+static void
+check_buf (char value, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("%s: byte %zu is %02hhx instead of %02hhx",
+            who, i, buf[i], value);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  msg ("fill buffer");
+  memset (buf, 0x5a, sizeof buf);
+
+  msg ("fork");
+  child = fork ();
+  if (child == 0)
+    {
+      check_buf (0x5a, "child before write");
+      memset (buf, 0xa5, sizeof buf);
+      check_buf (0xa5, "child after write");
+      exit (0x42);
+    }
+  CHECK (child != PID_ERROR, "fork returned a child");
+
+  msg ("overwrite parent's copy");
+  memset (buf, 0x33, sizeof buf);
+
+  CHECK (wait (child) == 0x42, "wait for child");
+
+  msg ("check parent's copy");
+  check_buf (0x33, "parent");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) fill buffer
+(fork-cow) fork
+(fork-cow) fork returned a child
+(fork-cow) overwrite parent's copy
+(fork-cow) wait for child
+(fork-cow) check parent's copy
+(fork-cow) end
+EOF
+pass;
@@ -0,0 +1,57 @@
+/* Fills 512 kB with pseudo-random data and forks 4 children at
+   once.  Each child checks the data, then encrypts its copy with
+   its own key and decrypts it again, so the children copy the
+   shared pages out from under each other while they compete for
+   memory and swap.  The parent's data must come through unchanged. */
+
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/cksum.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (512 * 1024)
+#define CHILD_CNT 4
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  struct arc4 arc4;
+  unsigned long sum;
+  int i;
+
+  msg ("fill buffer");
+  arc4_init (&arc4, "fork-many", 9);
+  arc4_crypt (&arc4, buf, SIZE);
+  sum = cksum (buf, SIZE);
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      children[i] = fork ();
+      if (children[i] == 0)
+        {
+          char key = 'a' + i;
+
+          if (cksum (buf, SIZE) != sum)
+            fail ("child %d: data changed before write", i);
+
+          arc4_init (&arc4, &key, 1);
+          arc4_crypt (&arc4, buf, SIZE);
+          arc4_init (&arc4, &key, 1);
+          arc4_crypt (&arc4, buf, SIZE);
+
+          if (cksum (buf, SIZE) != sum)
+            fail ("child %d: data changed after write", i);
+          exit (i);
+        }
+      CHECK (children[i] != PID_ERROR, "fork child %d", i);
+    }
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    CHECK (wait (children[i]) == i, "wait for child %d", i);
+
+  CHECK (cksum (buf, SIZE) == sum, "parent's data unchanged");
+}
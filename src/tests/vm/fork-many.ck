@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-many) begin
+(fork-many) fill buffer
+(fork-many) fork child 0
+(fork-many) fork child 1
+(fork-many) fork child 2
+(fork-many) fork child 3
+(fork-many) wait for child 0
+(fork-many) wait for child 1
+(fork-many) wait for child 2
+(fork-many) wait for child 3
+(fork-many) parent's data unchanged
+(fork-many) end
+EOF
+pass;
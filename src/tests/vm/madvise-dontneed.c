@@ -0,0 +1,67 @@
+/* Fills a page of static data and a page of the stack, maps a
+   file, and discards all three with madvise(MADV_DONTNEED).  The
+   written data page has nowhere to be read back from, so it must
+   be kept; the stack page must come back zeroed; and the mapped
+   page, which was never written, must read as the file again. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ACTUAL ((char *) 0x10000000)
+
+static char data[2 * PAGE_SIZE];
+
+/* Returns the first page boundary at or after P. */
+static char *
+page_align (char *p)
+{
+  return (char *) (((uintptr_t) p + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+}
+
+/* Fails unless the PAGE_SIZE bytes at P all equal VALUE. */
+static void
+check_page (const char *p, char value, const char *what)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (p[i] != value)
+      fail ("%s: byte %zu is %02hhx instead of %02hhx",
+            what, i, p[i], value);
+}
+
+void
+test_main (void)
+{
+  char stack[2 * PAGE_SIZE];
+  char *data_page = page_align (data);
+  char *stack_page = page_align (stack);
+  int handle;
+  mapid_t map;
+
+  memset (data_page, 0x5a, PAGE_SIZE);
+  memset (stack_page, 0xa5, PAGE_SIZE);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)), "read mapping");
+
+  CHECK (madvise (data_page, PAGE_SIZE, MADV_DONTNEED),
+         "discard data page");
+  check_page (data_page, 0x5a, "data page");
+
+  CHECK (madvise (stack_page, PAGE_SIZE, MADV_DONTNEED),
+         "discard stack page");
+  check_page (stack_page, 0, "stack page");
+
+  CHECK (madvise (ACTUAL, PAGE_SIZE, MADV_DONTNEED),
+         "discard mapped page");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)), "read mapping again");
+
+  munmap (map);
+  close (handle);
+}
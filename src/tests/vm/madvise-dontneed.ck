@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise-dontneed) begin
+(madvise-dontneed) open "sample.txt"
+(madvise-dontneed) mmap "sample.txt"
+(madvise-dontneed) read mapping
+(madvise-dontneed) discard data page
+(madvise-dontneed) discard stack page
+(madvise-dontneed) discard mapped page
+(madvise-dontneed) read mapping again
+(madvise-dontneed) end
+EOF
+pass;
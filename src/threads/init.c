@@ -34,12 +34,17 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/pagein.h"
+#include "vm/share.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -49,7 +54,8 @@ uint32_t *init_page_dir;
 static bool format_filesys;
 
 /* -filesys, -scratch, -swap: Names of block devices to use,
-   overriding the defaults. */
+   overriding the defaults.  -swap may name several, separated by
+   commas. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
@@ -71,6 +77,9 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+#ifdef VM
+static void locate_swap_devices (const char *names);
+#endif
 #endif
 
 int main (void) NO_RETURN;
@@ -102,6 +111,7 @@ main (void)
   malloc_init ();
   paging_init ();
   frame_init (user_page_limit);   // PROJECT 3
+  share_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -133,6 +143,8 @@ main (void)
 
   /*Added for VM */
   swap_init ();
+  frame_start_pageout ();
+  pagein_init ();
 
   printf ("Boot complete.\n");
   
@@ -254,6 +266,8 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ra"))
+        file_readahead_max = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -266,6 +280,23 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-vm-lowat"))
+        frame_low_watermark = atoi (value);
+      else if (!strcmp (name, "-vm-hiwat"))
+        frame_high_watermark = atoi (value);
+      else if (!strcmp (name, "-swap-cache"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-vm-stats"))
+        page_stats_on_exit = true;
+      else if (!strcmp (name, "-large-pages"))
+        frame_large_pages = true;
+      else if (!strcmp (name, "-vm-policy"))
+        {
+          if (value == NULL || !frame_set_policy (value))
+            PANIC ("unknown page replacement policy `%s'", value);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -380,14 +411,23 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ra=SECTORS        Read ahead up to SECTORS sectors, 0 for none.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[,...]   Swap to BDEV, striped over each one given.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -vm-lowat=COUNT    Start paging out below COUNT free frames.\n"
+          "  -vm-hiwat=COUNT    Stop paging out at COUNT free frames.\n"
+          "  -swap-cache=PAGES  Keep up to PAGES pages of compressed swap in RAM.\n"
+          "  -vm-stats          Print each process's paging statistics at exit.\n"
+          "  -large-pages       Map 4 MB aligned user regions with 4 MB pages.\n"
+          "  -vm-policy=NAME    Replace pages by clock, second-chance, aging or 2q.\n"
 #endif
           );
   shutdown_power_off ();
@@ -401,10 +441,47 @@ locate_block_devices (void)
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_swap_devices (swap_bdev_name);
 #endif
 }
 
+#ifdef VM
+/* Gives the swap role to each of the comma-separated block devices in
+   NAMES, or to the first swap device in probe order if NAMES is
+   null, and hands them to the swap code, which stripes across them.
+   The first one is also the BLOCK_SWAP role device. */
+static void
+locate_swap_devices (const char *names)
+{
+  char buf[64];
+  char *name, *save_ptr;
+
+  if (names == NULL)
+    {
+      locate_block_device (BLOCK_SWAP, NULL);
+      if (block_get_role (BLOCK_SWAP) != NULL)
+        swap_add_device (block_get_role (BLOCK_SWAP));
+      return;
+    }
+
+  if (strlen (names) >= sizeof buf)
+    PANIC ("-swap device list \"%s\" is too long", names);
+  strlcpy (buf, names, sizeof buf);
+  for (name = strtok_r (buf, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      printf ("%s: using %s\n", block_type_name (BLOCK_SWAP),
+              block_name (block));
+      if (block_get_role (BLOCK_SWAP) == NULL)
+        block_set_role (BLOCK_SWAP, block);
+      swap_add_device (block);
+    }
+}
+#endif
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
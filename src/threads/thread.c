@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <fixed-point.h> //helper functions for fixed point conversions
 #include <hash.h>
+#include <limits.h>
 #include <random.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -579,8 +580,17 @@ init_thread (struct thread *t, const char *name, int priority)
   } else {
     t->sup_page_table = NULL;
   }
-  t->exec_addr = NULL;
+  list_init (&t->vmas);
   lock_init (&t->exit_lock);
+  t->ra_next = NULL;
+  t->ra_window = 0;
+  t->stack_next = NULL;
+  t->stack_window = 0;
+  t->rss = 0;
+  t->rss_min = 0;
+  t->rss_max = INT_MAX;
+  t->pff_start = 0;
+  t->pff_faults = 0;
 
   t->magic = THREAD_MAGIC;
 
@@ -39,6 +39,18 @@ struct mmap_entry {
   int length;
 };
 
+/* Paging activity of a process, read by the vmstat system call and
+   printed at exit with -vm-stats. */
+struct vm_stats {
+  unsigned minor_faults;  // pages mapped without I/O
+  unsigned major_faults;  // pages read in from a file or swap
+  unsigned evicted;       // pages of this process evicted
+  unsigned stolen;        // frames this process evicted from others
+  unsigned swap_ins;      // pages read back from swap
+  unsigned swap_outs;     // pages of this process written to swap
+  unsigned pin_waits;     // times it waited with every frame pinned
+};
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -147,11 +159,20 @@ struct thread
    /* Project three additions */
     struct lock sup_page_table_lock;
     struct hash *sup_page_table;
+    struct list vmas;      // address space ranges, see vm/vma.h
     struct mmap_entry mmap_files[MAX_FD_INDEX + 1]; // mmap_ids = fds
-    void *exec_addr;                      // look in load_segment
-    int exec_length;
     void *esp;
     struct lock exit_lock; // used to synchronize eviction during exit 
+    const void *ra_next;   // upage a sequential fault would hit next
+    int ra_window;         // current fault-around window in pages
+    const void *stack_next;  // upage the next stack growth fault would hit
+    int stack_window;      // current stack pre-growth run in pages
+    int rss;               // private frames resident, see vm/frame.c
+    int rss_min;           // soft resident set quotas, adapted from
+    int rss_max;           //   the page fault frequency
+    int64_t pff_start;     // tick the current fault window started
+    int pff_faults;        // faults taken in the window so far
+    struct vm_stats vm_stats;
   };
 
 struct exit_info
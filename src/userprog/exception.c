@@ -5,6 +5,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "vm/frame.h"
 #include "vm/page.h"
 
 /* Number of page faults processed. */
@@ -179,15 +180,19 @@ page_fault (struct intr_frame *f)
 
   if (fault_addr == NULL || fault_addr >= PHYS_BASE) 
     print_and_kill (f, not_present, write, user, fault_addr);
+  frame_pff_fault ();
 
   if (page_entry_present (t, fault_addr)) {
     if (write && !page_writable (t, fault_addr))
       print_and_kill (f, not_present, write, user, fault_addr);
-    page_map (fault_addr, false);
-  } else if (is_stack_growth (f, fault_addr)) {
-    page_add_entry (t->sup_page_table, fault_addr, NULL, _STACK, 
-                    UNMAPPED, -1, -1, NULL, -1, true, true);
-    page_map (fault_addr, false);
+    if (!not_present)
+      page_unshare (fault_addr, false);  // write to a copy-on-write page
+    else if (write || !page_map_zero (fault_addr))
+      page_map (fault_addr, false);
+  } else if (is_stack_growth (f, fault_addr) && page_grow_stack (fault_addr)) {
+    if (write || !page_map_zero (fault_addr))
+      page_map (fault_addr, false);
+    page_pregrow_stack (fault_addr);
   } else {
     print_and_kill (f, not_present, write, user, fault_addr);
   }
@@ -3,12 +3,36 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
 
+/* 4 MB pages.  Once pagedir_enable_large_pages() has turned on the
+   CPU's page size extension, a 4 MB aligned user region whose 1024
+   pages are mapped, in order, to one 4 MB aligned run of physical
+   frames can be promoted to a single PDE with PTE_PS set.  The page
+   table it replaces is kept in a second page allocated right after
+   each page directory, so splitting back to 4 kB pages, which every
+   change to one of the region's PTEs does first, never allocates.
+   Only the accessed bit may be changed without splitting.  The 4 MB
+   page is always mapped read-only, so the first write to the region
+   faults and splits it, and each page's dirty bit stays in its own
+   saved PTE. */
+static bool large_pages;        // page size extension on
+static unsigned split_cnt;      // large pages split back
+
+#define LARGE_PAGE_MASK (PTSPAN - 1)
+
+/* Returns the page tables saved for PD's promoted PDEs. */
+static uint32_t **
+saved_pts (uint32_t *pd)
+{
+  return (uint32_t **) (pd + PGSIZE / sizeof *pd);
+}
+
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
    Returns the new page directory, or a null pointer if memory
@@ -16,14 +40,18 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_multiple (0, large_pages ? 2 : 1);
   if (pd != NULL)
     memcpy (pd, init_page_dir, PGSIZE);
+  if (pd != NULL && large_pages)
+    memset (saved_pts (pd), 0, PGSIZE);
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  With VM the frame table owns user pages and
+   page_destroy() has already freed them, so only the page tables
+   themselves are freed. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
@@ -36,15 +64,42 @@ pagedir_destroy (uint32_t *pd)
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
-        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pt = (*pde & PTE_PS ? saved_pts (pd)[pde - pd]
+                        : pde_get_pt (*pde));
+#ifndef VM
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
+#endif
         palloc_free_page (pt);
       }
-  palloc_free_page (pd);
+  palloc_free_multiple (pd, large_pages ? 2 : 1);
+}
+
+/* Splits the 4 MB page that PDE, an entry of PD, maps back into
+   the page table it was promoted from.  The accessed bit the large
+   page gathered is passed on to all of its pages; it was never
+   writable, so the saved PTEs' dirty bits are still exact. */
+static void
+split_large_page (uint32_t *pd, uint32_t *pde)
+{
+  enum intr_level old_level = intr_disable ();
+  if (*pde & PTE_PS)
+    {
+      uint32_t *pt = saved_pts (pd)[pde - pd];
+      uint32_t bits = *pde & PTE_A;
+      size_t i;
+
+      for (i = 0; i < PGSIZE / sizeof *pt; i++)
+        pt[i] |= bits;
+      *pde = pde_create (pt);
+      saved_pts (pd)[pde - pd] = NULL;
+      split_cnt++;
+      invalidate_pagedir (pd);
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -52,9 +107,12 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR is in a 4 MB page, it is split first when SPLIT is
+   true; otherwise the PDE is returned, whose flags read like a
+   PTE's. */
 static uint32_t *
-lookup_page (uint32_t *pd, const void *vaddr, bool create)
+lookup_page (uint32_t *pd, const void *vaddr, bool create, bool split)
 {
   uint32_t *pt, *pde;
 
@@ -80,6 +138,13 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  if (*pde & PTE_PS)
+    {
+      if (!split)
+        return pde;
+      split_large_page (pd, pde);
+    }
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -106,7 +171,7 @@ pagedir_set_page (uint32_t *pd, const void *upage, void *kpage, bool writable)
   ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
   ASSERT (pd != init_page_dir);
 
-  pte = lookup_page (pd, upage, true);
+  pte = lookup_page (pd, upage, true, true);
 
   if (pte != NULL) 
     {
@@ -129,8 +194,11 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 
   ASSERT (is_user_vaddr (uaddr));
   
-  pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
+  pte = lookup_page (pd, uaddr, false, false);
+  if (pte != NULL && (*pte & PTE_PS) != 0)
+    return ptov (*pte & ~LARGE_PAGE_MASK) + ((uintptr_t) uaddr
+                                             & LARGE_PAGE_MASK);
+  else if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page (*pte) + pg_ofs (uaddr);
   else
     return NULL;
@@ -148,7 +216,7 @@ pagedir_clear_page (uint32_t *pd, const void *upage)
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
-  pte = lookup_page (pd, upage, false);
+  pte = lookup_page (pd, upage, false, true);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
@@ -158,12 +226,15 @@ pagedir_clear_page (uint32_t *pd, const void *upage)
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
-   installed.
+   installed.  Within a 4 MB page, the PTE it was promoted from
+   is consulted.
    Returns false if PD contains no PTE for VPAGE. */
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_page (pd, vpage, false, false);
+  if (pte != NULL && (*pte & PTE_PS) != 0)
+    pte = &saved_pts (pd)[pte - pd][pt_no (vpage)];
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -172,7 +243,7 @@ pagedir_is_dirty (uint32_t *pd, const void *vpage)
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_page (pd, vpage, false, true);
   if (pte != NULL) 
     {
       if (dirty)
@@ -185,6 +256,33 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
     }
 }
 
+/* Returns true if the PTE for virtual page VPAGE in PD is
+   writable by the user process.
+   Returns false if PD contains no PTE for VPAGE. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false, false);
+  return pte != NULL && (*pte & PTE_W) != 0;
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD.  Other bits in the page table entry are
+   preserved. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false, true);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_pagedir (pd);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -192,16 +290,17 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_page (pd, vpage, false, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  If VPAGE is in a 4 MB page, the bit is shared by
+   all of that page. */
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_page (pd, vpage, false, false);
   if (pte != NULL) 
     {
       if (accessed)
@@ -214,6 +313,84 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
     }
 }
 
+/* Turns on 4 MB pages, if the CPU has the page size extension.
+   Must be called before the first user page directory is created.
+   Returns false if the CPU lacks it. */
+bool
+pagedir_enable_large_pages (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint32_t cr4;
+
+  /* CPUID leaf 1 reports PSE in bit 3 of EDX, and bit 4 of CR4
+     enables it.  See [IA32-v3a] 3.7.3 "Mixing 4-KByte and
+     4-MByte Pages". */
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & (1 << 3)) == 0)
+    return false;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= 1 << 4;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+  large_pages = true;
+  return true;
+}
+
+/* Maps the 4 MB aligned user region at UPAGE in PD with one 4 MB
+   page, if all of its pages are mapped, in order and with the same
+   permissions, to a 4 MB aligned run of physical frames.  The 4 MB
+   page is read-only even if the region is writable; a write fault on
+   it is resolved by pagedir_set_writable(), which splits it.
+   Returns true if it was promoted. */
+bool
+pagedir_promote (uint32_t *pd, const void *upage)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  bool success = false;
+  enum intr_level old_level;
+
+  ASSERT (((uintptr_t) upage & LARGE_PAGE_MASK) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  if (!large_pages)
+    return false;
+
+  old_level = intr_disable ();
+  if ((*pde & PTE_P) != 0 && (*pde & PTE_PS) == 0)
+    {
+      uint32_t *pt = pde_get_pt (*pde);
+      uint32_t base = pt[0] & PTE_ADDR;
+      uint32_t perms = pt[0] & (PTE_P | PTE_W | PTE_U);
+      size_t i;
+
+      success = (base & LARGE_PAGE_MASK) == 0 && (perms & PTE_P) != 0;
+      for (i = 0; success && i < PGSIZE / sizeof *pt; i++)
+        success = ((pt[i] & PTE_ADDR) == base + i * PGSIZE
+                   && (pt[i] & (PTE_P | PTE_W | PTE_U)) == perms);
+      if (success)
+        {
+          saved_pts (pd)[pde - pd] = pt;
+          *pde = base | (perms & ~PTE_W) | PTE_A | PTE_PS;
+          invalidate_pagedir (pd);
+        }
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Returns true if UPAGE is in a 4 MB page in PD. */
+bool
+pagedir_is_large (uint32_t *pd, const void *upage)
+{
+  return (pd[pd_no (upage)] & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+/* Returns the number of 4 MB pages split back into 4 kB pages. */
+unsigned
+pagedir_split_cnt (void)
+{
+  return split_cnt;
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -11,9 +11,15 @@ void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, const void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+bool pagedir_enable_large_pages (void);
+bool pagedir_promote (uint32_t *pd, const void *upage);
+bool pagedir_is_large (uint32_t *pd, const void *upage);
+unsigned pagedir_split_cnt (void);
 uint32_t curren_pd (void );
 
 #endif /* userprog/pagedir.h */
@@ -21,8 +21,11 @@
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/pagein.h"
+#include "vm/vma.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -112,6 +115,22 @@ setup_user_stack (void **esp, char **args, char *file_name)
   palloc_free_page(buf);
 }
 
+/*Initlize T's exit info and put it in its parent's list
+  of children */
+static void
+add_exit_info (struct thread *t)
+{
+  if (t->parent != NULL) {
+    struct exit_info *info = malloc (sizeof(struct exit_info));
+    ASSERT (info != NULL);
+    info->tid = t->tid;
+    info->exit_status = (int) NULL;  // only set this upon exit
+    info->child = t;
+    t->exit_info_elem = &info->elem;
+    list_push_back (&t->parent->children_exit_info, &info->elem);
+  }
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -131,17 +150,7 @@ start_process (void *aux)
 
   struct thread *t = thread_current();
   if (success) {
-    /*Initlize my exit info and put it in my parent's list
-      of children */
-    if (t->parent != NULL) {
-      struct exit_info *info = malloc (sizeof(struct exit_info));
-      ASSERT (info != NULL);
-      info->tid = t->tid;
-      info->exit_status = (int) NULL;  // only set this upon exit
-      info->child = t;
-      t->exit_info_elem = &info->elem;
-      list_push_back (&t->parent->children_exit_info, &info->elem);
-    }
+    add_exit_info (t);
     
     /* initialize file ptrs to 0 */
     memset(t->file_ptrs, 0, sizeof(struct file *) * MAX_FD_INDEX+1);  
@@ -175,6 +184,116 @@ start_process (void *aux)
   NOT_REACHED ();
 }
 
+/* What a forked child copies from its parent. */
+struct fork_info
+  {
+    struct thread *parent;
+    struct intr_frame if_;      /* Parent's user context at fork(). */
+  };
+
+/* Starts a new process that is a copy of the current one and resumes
+   from the user context saved in F, the interrupt frame of the fork
+   system call, with 0 as the system call's result.  Memory is copied
+   on write (see page_fork()).  Returns the child's thread id, or
+   TID_ERROR if the thread cannot be created or the copy fails. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+
+  struct fork_info *info = malloc (sizeof (struct fork_info));
+  if (info == NULL)
+    return TID_ERROR;
+  info->parent = t;
+  info->if_ = *f;
+
+  tid_t tid = thread_create (t->name, PRI_DEFAULT, start_fork, info);
+
+  if (tid == TID_ERROR) {
+    free (info);
+  } else {
+    sema_down (&t->child_exec_sema);
+    if (!t->child_exec_success)
+      return TID_ERROR;
+  }
+
+  return tid;
+}
+
+/* Gives the current thread its own handle on PARENT's executable and
+   on each of PARENT's open files, at the same position.  Positions
+   are not shared afterwards.  Returns false if a file can't be
+   reopened. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  bool success = true;
+
+  t->my_exec = file_reopen (parent->my_exec);
+  if (t->my_exec != NULL)
+    file_deny_write (t->my_exec);
+  else
+    success = false;
+
+  int i;
+  for (i = 2; i <= MAX_FD_INDEX && success; i++) {
+    if (parent->file_ptrs[i] == NULL)
+      continue;
+    t->file_ptrs[i] = file_reopen (parent->file_ptrs[i]);
+    if (t->file_ptrs[i] == NULL)
+      success = false;
+    else
+      file_seek (t->file_ptrs[i], file_tell (parent->file_ptrs[i]));
+  }
+  t->next_open_file_index = parent->next_open_file_index;
+
+  return success;
+}
+
+/* A thread function that makes a forked process a copy of its parent,
+   which waits in process_fork() meanwhile, and starts it running. */
+static void
+start_fork (void *aux)
+{
+  struct fork_info *info = aux;
+  struct thread *parent = info->parent;
+  struct intr_frame if_ = info->if_;
+  struct thread *t = thread_current ();
+  bool success = false;
+
+  free (info);
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL) {
+    process_activate ();
+
+    if (fork_files (parent)) {
+      lock_acquire (&parent->exit_lock);
+      success = page_fork (parent);
+      lock_release (&parent->exit_lock);
+    }
+  }
+
+  if (success)
+    add_exit_info (t);
+
+  /* signal parent thread to return */  
+  parent->child_exec_success = success; 
+  sema_up (&parent->child_exec_sema);
+
+  if (!success) {
+    t->exit_info_elem = NULL;
+    t->exit_status = -1;
+    thread_exit ();
+  }
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -212,17 +331,6 @@ process_wait (tid_t child_tid)
   return -1;
 }
 
-static void
-sup_page_table_action_func (struct hash_elem *e, void *aux UNUSED)
-{
-  struct sup_page_entry *entry = (struct sup_page_entry *) 
-                                  hash_entry (e, struct sup_page_entry, elem);
-  lock_acquire (&entry->lock);
-  page_unmap_via_entry (thread_current (), entry);
-  lock_release (&entry->lock);
-  free (entry);  
-}
-
 /* Free the current process's resources. */
 void
 process_exit (void)
@@ -245,17 +353,18 @@ process_exit (void)
  
   /* free the supplemental page table */
   if (t->sup_page_table != NULL) {
+    pagein_cancel (t);
     lock_acquire (&t->exit_lock);
     lock_acquire (&t->sup_page_table_lock);
-    hash_destroy (t->sup_page_table, &sup_page_table_action_func); 
+    page_writeback (t, NULL, PHYS_BASE);  // mmap'd files, in file order
+    page_destroy (t);
+    vma_destroy (t);
     lock_release (&t->sup_page_table_lock);
     lock_release (&t->exit_lock);
   }
 
   if (t->my_exec != NULL) {  // checks if executable
-    lock_acquire(&filesys_lock);
     file_close(t->my_exec);
-    lock_release(&filesys_lock);
   }
 
   /*Make sure all files opened are closed, starts at i = 2
@@ -265,20 +374,23 @@ process_exit (void)
   int i;
   for (i = 2; i <= MAX_FD_INDEX; i++) {
     if (t->mmap_files[i].file != NULL) {
-      lock_acquire(&filesys_lock);
       file_close(t->mmap_files[i].file);
-      lock_release(&filesys_lock);
     }
 
     curr_file = t->file_ptrs[i];
     if (curr_file != NULL) {
-      lock_acquire(&filesys_lock);
       file_close(curr_file);
-      lock_release(&filesys_lock);
     }
   }
 
   printf ("%s: exit(%d)\n", t->name, t->exit_status);
+  if (page_stats_on_exit) {
+    struct vm_stats *s = &t->vm_stats;
+    printf ("%s: vm: %u minor faults, %u major faults, %u evicted, "
+            "%u stolen, %u swap-ins, %u swap-outs, %u pin waits\n",
+            t->name, s->minor_faults, s->major_faults, s->evicted,
+            s->stolen, s->swap_ins, s->swap_outs, s->pin_waits);
+  }
 
   // If parent is waiting on this thread to finish, unblock the parent
   if (t->parent != NULL) {
@@ -400,8 +512,6 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 bool
 load (const char *file_name, void (**eip) (void), void **esp) 
 {
-  lock_acquire(&filesys_lock);
-
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
@@ -425,9 +535,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   /* Read and verify executable header. */
-  //lock_acquire(&filesys_lock);
   int num_bytes = file_read (file, &ehdr, sizeof ehdr);
-  //lock_release(&filesys_lock);
   if ( num_bytes != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
@@ -522,7 +630,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
     file_close (file);
   }
 
-  lock_release(&filesys_lock);
   return success;
 }
 
@@ -597,38 +704,11 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
- // execsize += read_bytes (rounded to nearest page); 
 
-  struct thread *t = thread_current ();
-  /* Store first uaddr of executable */
-  if (t->exec_addr == NULL) {
-    t->exec_addr = upage;
-    t->exec_length = 0;
-  }
-  if (read_bytes % PGSIZE > 0) 
-    t->exec_length += (read_bytes / PGSIZE + 1) * PGSIZE;
-  else
-    t->exec_length += read_bytes;
-
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Store sup table page entry, does not actually allocate memory */
-      page_add_entry (t->sup_page_table, upage, NULL, _EXEC, UNMAPPED, -1, 
-                      page_read_bytes, file, ofs, false, writable);
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += page_read_bytes;
-    }
-  return true;
+  /* Describe the segment as one range; pages are read in on fault and
+     the final ZERO_BYTES bytes come out zeroed. */
+  return page_add_range (upage, (read_bytes + zero_bytes) / PGSIZE, _EXEC,
+                         file, ofs, read_bytes, writable);
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -637,16 +717,12 @@ static bool
 setup_stack (void **esp) 
 {
   uint8_t *kpage;
-  struct thread *t = thread_current ();
 
-  /* If an entry already exists, return false and thereby panic */
-  if (page_entry_present (t, PHYS_BASE - PGSIZE)) 
+  /* Add the stack range, one page for now, failing if something is
+     already there */
+  if (!page_add_range (PHYS_BASE - PGSIZE, 1, _STACK, NULL, 0, 0, true))
     return false;
 
-  /* Add an entry to the supplemental table for this first stack page */
-  page_add_entry (t->sup_page_table, PHYS_BASE - PGSIZE, NULL, _STACK,
-                  UNMAPPED, -1, -1, NULL, -1, true, true);
-
   /* Allocate memory and map it to this user vaddr */
   kpage = page_map (PHYS_BASE - PGSIZE, true); 
   ASSERT (kpage != NULL);
@@ -1,4 +1,5 @@
 #include "userprog/syscall.h"
+#include <round.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 
@@ -35,6 +36,9 @@ static unsigned tell (int fd);
 static void close (int fd);
 static mapid_t mmap (int fd, void *addr);
 static void munmap (mapid_t mapping);
+static bool madvise (void *addr, unsigned length, int advice);
+static void vmstat (struct vm_stats *stats);
+static void msync (mapid_t mapping);
 
 #define MAX_WRITE_SIZE 500
 
@@ -107,6 +111,20 @@ syscall_handler (struct intr_frame *f)
     case SYS_MUNMAP:
       munmap ( * (mapid_t *) get_arg_n(1, esp));
       break;
+    case SYS_FORK:
+      f->eax = (pid_t) process_fork (f);  // PID_ERROR if it fails
+      break;
+    case SYS_MADVISE:
+      f->eax = madvise (*(void **) get_arg_n(1, esp), 
+                        *(unsigned *) get_arg_n(2, esp),
+                        *(int *) get_arg_n(3, esp));
+      break;
+    case SYS_VMSTAT:
+      vmstat (*(struct vm_stats **) get_arg_n(1, esp));
+      break;
+    case SYS_MSYNC:
+      msync (*(mapid_t *) get_arg_n(1, esp));
+      break;
     default:
       ASSERT (false);
       break;  
@@ -124,52 +142,21 @@ is_stack_growth (const void *upage)
   return false;
 }
 
+/* Validates, faults in and pins the SIZE bytes at PTR, first growing
+   the stack down to PTR if it lies between the stack and esp. */
 static bool
-map_and_pin (const void *upage, bool write)
+pin_range (const void *ptr, int size, bool write)
 {
-  struct thread *t = thread_current ();
-
-  if (pagedir_get_page (t->pagedir, upage) == NULL) {
-
-    if (page_entry_present (t, upage)) {
-      if (write && !page_writable (t, upage))
-        return false;
-      page_map (upage, true);
-    } else if (is_stack_growth (upage)) {
-      page_add_entry (t->sup_page_table, upage, NULL, _STACK, UNMAPPED, -1, -1, 
-                      NULL, -1, true, true);
-      page_map (upage, true);
-    } else {
-      return false;
-    }
-
-  } else {
-
-    if (write && !page_writable (t, upage))
-      return false;
-    if (!frame_pin (upage))  // returns false if just evicted
-      page_map (upage, true);
-
-  }
-
-  return true;
+  if (is_stack_growth (ptr))
+    page_grow_stack (ptr);  // page_pin_range() rejects it if this fails
+  return page_pin_range (ptr, size, write);
 }
 
 static void
 unpin_pages (const void *upage, int size)
 {
-  void *last_byte = (void *) ((unsigned) upage + size)-1;
-
-  int page_num_first_byte = (unsigned) upage / PGSIZE;
-  int page_num_last_byte = (unsigned) last_byte / PGSIZE;
-  int pages_in_between = page_num_first_byte - page_num_last_byte;
-  const void *curr_page = upage;
-
-  int i;
-  for (i = 0; i < pages_in_between + 1; i++) {
-    frame_unpin (curr_page);
-    curr_page += PGSIZE;
-  }
+  frame_unpin_range (pg_round_down (upage), 
+                     pg_round_up ((const char *) upage + size));
 }
 
 /*
@@ -184,22 +171,10 @@ mem_valid (const void *ptr, int size, bool write)
     return false;
 
   void *last_byte = (void *) ((unsigned) ptr + size)-1;
-  if (last_byte >= PHYS_BASE)
+  if (last_byte >= PHYS_BASE || (unsigned) ptr + size < (unsigned) ptr)
     return false;
 
-  int page_num_first_byte = (unsigned) ptr / PGSIZE;
-  int page_num_last_byte = (unsigned) last_byte / PGSIZE;
-  int pages_in_between = page_num_last_byte - page_num_first_byte;
-  const void *curr_page = ptr; 
-
-  int i;
-  for (i = 0; i < pages_in_between + 1; i++) {
-    if (!map_and_pin (curr_page, write))
-      return false;
-    curr_page += PGSIZE;
-  }
-
-  return true;
+  return pin_range (ptr, size, write);
 } 
 
 // PROBLEM!! NEED TO UNPEN BEFORE RETURNING IN ALL FUNCTIONS!!!!
@@ -207,7 +182,7 @@ static bool
 str_valid (const char *ptr) 
 {
   if (ptr == (char *) NULL || ptr >= (char *) PHYS_BASE || 
-      !map_and_pin (ptr, false))
+      !pin_range (ptr, 1, false))
     return false;
 
   const char *curr_byte_ptr = ptr;
@@ -218,7 +193,7 @@ str_valid (const char *ptr)
 
     if ((unsigned) curr_byte_ptr % PGSIZE == 0 &&
         (curr_byte_ptr >= (char *) PHYS_BASE || 
-        !map_and_pin (curr_byte_ptr, false))) 
+        !pin_range (curr_byte_ptr, 1, false))) 
       return false;
   }
   return false;   // should never get here
@@ -270,9 +245,7 @@ create (const char *file, unsigned initial_size)
   if (!str_valid(file)) 
     exit(-1);
 
-  lock_acquire(&filesys_lock);
   bool create = filesys_create (file, initial_size);
-  lock_release(&filesys_lock);
 
   unpin_pages (file, strlen(file));
   return create;
@@ -284,9 +257,7 @@ remove (const char *file)
   if (!str_valid(file)) 
     return false;
 
-  lock_acquire(&filesys_lock);
   bool remove = filesys_remove (file);
-  lock_release(&filesys_lock);
 
   unpin_pages (file, strlen(file));
   return remove;
@@ -306,9 +277,7 @@ open (const char *file)
 
   int new_fd = t->next_open_file_index;
 
-  lock_acquire(&filesys_lock);
   t->file_ptrs[new_fd] = filesys_open (file);
-  lock_release(&filesys_lock);
 
   if (t->file_ptrs[new_fd] == NULL) {
     unpin_pages (file, strlen(file));
@@ -335,9 +304,7 @@ filesize (int fd)
   if (fd == 0 || fd == 1 || fd >= MAX_FD_INDEX + 1 || t->file_ptrs[fd] == NULL)
     exit(-1);
 
-  lock_acquire(&filesys_lock);
   int length = file_length (thread_current ()->file_ptrs[fd]);
-  lock_release(&filesys_lock);
 
   return length;
 }
@@ -368,9 +335,7 @@ read (int fd, void *buffer, unsigned length)
     return index;
   }
 
-  lock_acquire(&filesys_lock);
   int read_len = file_read (t->file_ptrs[fd], buffer, length);
-  lock_release(&filesys_lock);
 
   unpin_pages (buffer, length); // mem_valid validates and pins memory
   return read_len;
@@ -408,9 +373,7 @@ write (int fd, const void *buffer, unsigned length)
     return length;
   } 
   
-  lock_acquire(&filesys_lock);
   int write_len = file_write (t->file_ptrs[fd], buffer, length);
-  lock_release(&filesys_lock);
 
   unpin_pages (buffer, length); // mem_valid validates and pins memory
   return write_len;
@@ -423,9 +386,7 @@ seek (int fd, unsigned position)
   if (fd == 0 || fd == 1 || fd >= MAX_FD_INDEX + 1|| t->file_ptrs[fd] == NULL)
     exit(-1); 
   
-  lock_acquire(&filesys_lock); 
   file_seek (t->file_ptrs[fd], position);
-  lock_release(&filesys_lock);
 }
 
 static unsigned
@@ -435,9 +396,7 @@ tell (int fd)
   if (fd == 0 || fd == 1 || fd >= MAX_FD_INDEX + 1 || t->file_ptrs[fd] == NULL)
      exit(-1); 
   
-  lock_acquire(&filesys_lock);
   int position = file_tell(t->file_ptrs[fd]);
-  lock_release(&filesys_lock);
 
   return position;
 }
@@ -449,9 +408,7 @@ close (int fd)
   if (fd == 0 || fd == 1 || fd >= MAX_FD_INDEX + 1 || t->file_ptrs[fd] == NULL)
      return; 
 
-  lock_acquire(&filesys_lock);
   file_close (t->file_ptrs[fd]);
-  lock_release(&filesys_lock);
 
   t->file_ptrs[fd] = NULL;
   t->next_open_file_index = fd;
@@ -470,29 +427,9 @@ virt_mem_free (int fd, void *addr)
   if (new_end >= stack_boundary)
     return false;
 
-  /* Check for overlap with other mmap files */
-  int i;
-  for (i = 2; i <= MAX_FD_INDEX; i++) {
-
-    if (t->mmap_files[i].file != NULL) {
-      void *old_begin = t->mmap_files[i].addr;
-      void *old_end = pg_round_up ((void *) ((unsigned) old_begin + 
-                                   t->mmap_files[i].length));
-      if ((new_begin >= old_begin && new_begin < old_end) || 
-          (new_end >= old_begin && new_end < old_end))
-        return false;
-    }
-  }
-
-  /* check to make sure it does not overlap with the executable */
-  void *exec_begin = t->exec_addr;
-  void *exec_end = pg_round_up ((void *) ((unsigned) exec_begin + 
-                                     t->exec_length));
-  if ((new_begin >= exec_begin && new_begin < exec_end) ||
-      (new_end >= exec_begin && new_end < exec_end))
-    return false;
-
-  return true;
+  /* Check for overlap with the executable, the stack and other mmap
+     files */
+  return page_range_free (new_begin, new_end);
 }
 
 static mapid_t
@@ -522,21 +459,11 @@ mmap (int fd, void *addr)
     return -1;
   }
 
-  int read_bytes = length;
-  int zero_bytes = PGSIZE - length % PGSIZE;
-  void *upage = addr;
-  int offset = 0;
-  bool writable = file_writable (file);
-
-  while (read_bytes > 0 || zero_bytes > 0) {
-    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-    size_t page_zero_bytes = PGSIZE - page_read_bytes;
-    page_add_entry (t->sup_page_table, upage, NULL, _FILE, UNMAPPED, -1, 
-                    page_read_bytes, file, offset, false, writable);
-    read_bytes -= page_read_bytes;
-    zero_bytes -= page_zero_bytes;
-    upage += PGSIZE;
-    offset += page_read_bytes;
+  /* One range for the whole file, pages are read in on fault */
+  if (!page_add_range (addr, DIV_ROUND_UP (length, PGSIZE), _FILE, file, 0,
+                       length, file_writable (file))) {
+    file_close (file);
+    return -1;
   }
 
   t->mmap_files[fd].file = file;
@@ -551,23 +478,57 @@ munmap (mapid_t mapping)
 {
   struct thread *t = thread_current ();
 
-  if (mapping == 0 || mapping == 1 || mapping >= MAX_FD_INDEX + 1 || 
+  if (mapping < 2 || mapping >= MAX_FD_INDEX + 1 || 
       t->mmap_files[mapping].file == NULL)
     return;
   
-  void *uaddr_start = t->mmap_files[mapping].addr;
-  void *uaddr_end = pg_round_up ((void *) ((unsigned) uaddr_start +
-                                 t->mmap_files[mapping].length));
-
-  void *upage = uaddr_start;
-  while (upage < uaddr_end) {
-    page_unmap_via_upage (t, upage);
-    page_remove_entry (upage);
-    upage += PGSIZE;
-  }
+  void *addr = t->mmap_files[mapping].addr;
+  page_remove_range (addr, pg_round_up ((char *) addr + 
+                                        t->mmap_files[mapping].length));
 
   file_close (t->mmap_files[mapping].file);
   t->mmap_files[mapping].file = NULL;
   t->mmap_files[mapping].addr = NULL;
   t->mmap_files[mapping].length = 0;
 }
+
+/* Gives the kernel a hint about how the pages of [ADDR, ADDR + LENGTH)
+   will be used, see page_advise().  ADDR must be page-aligned and the
+   range mapped. */
+static bool
+madvise (void *addr, unsigned length, int advice)
+{
+  char *end = (char *) addr + length;
+  if (pg_ofs (addr) != 0 || length == 0 || end < (char *) addr ||
+      end > (char *) PHYS_BASE)
+    return false;
+  if (advice < MADV_NORMAL || advice > MADV_DONTNEED)
+    return false;
+
+  return page_advise (addr, pg_round_up (end), advice);
+}
+
+/* Copies the current process's paging statistics to STATS. */
+static void
+vmstat (struct vm_stats *stats)
+{
+  if (!mem_valid (stats, sizeof *stats, true))
+    exit (-1);
+  memcpy (stats, &thread_current ()->vm_stats, sizeof *stats);
+  unpin_pages (stats, sizeof *stats);
+}
+
+/* Writes MAPPING's changed pages back to its file. */
+static void
+msync (mapid_t mapping)
+{
+  struct thread *t = thread_current ();
+
+  if (mapping < 2 || mapping >= MAX_FD_INDEX + 1 || 
+      t->mmap_files[mapping].file == NULL)
+    return;
+
+  void *addr = t->mmap_files[mapping].addr;
+  page_msync (addr, pg_round_up ((char *) addr + 
+                                 t->mmap_files[mapping].length));
+}
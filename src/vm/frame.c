@@ -1,18 +1,292 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <bitmap.h>
+#include <limits.h>
+#include <round.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
+#include "vm/share.h"
 
 #define FREE_PAGES_START_OFFSET 1024 * 1024
 
+#define FIRST_FRAME 1             // frame entries start at 1
+#define CLOCK_SWEEP_LIMIT 2       // revolutions before settling for best seen
+#define AGE_REFERENCED 0x80       // shifted into age when page was accessed
+#define CLEAN_SCAN_LIMIT 16       // frames to look past a cold dirty victim
+
 static struct frame_entry *frame_table;
-static struct lock frame_table_lock;  // only used in clock algorithm
 static int num_user_pages;            // only used in clock algorithm
 static int num_kernel_pages;          // used in getting frame_entry
+static int clock_hand = FIRST_FRAME;  // persists between evictions
+
+/* Free frames.  The frame table takes the whole user pool from palloc
+   at boot and keeps free frames on FRAME_PARTITIONS lists, frame I on
+   list I % FRAME_PARTITIONS, each with its own lock.  A thread takes
+   frames from the list its tid picks and only moves on to the others
+   when that one is empty, so concurrent page-ins rarely meet on a
+   lock.  Eviction needs no table-wide lock at all: the clock hand is
+   advanced atomically and a victim is claimed by try-locking it. */
+#define FRAME_PARTITIONS 4
+
+struct frame_partition {
+  struct lock lock;
+  struct list free;        // free frame entries
+  int free_cnt;            // length of FREE, may be read without LOCK
+};
+
+static struct frame_partition partitions[FRAME_PARTITIONS];
+
+/* Large page reservations.  With -large-pages, every 4 MB aligned run
+   of LARGE_FRAMES frames that palloc hands the frame table whole is
+   kept off the free lists as a reservation.  The first fault in a 4 MB
+   aligned region that one address space range covers claims a free
+   reservation for it, and each page of the region then gets the frame
+   at its own offset in the reservation, so that once every page is in,
+   pagedir_promote() can map the region with a single 4 MB page.
+   Evicting or unmapping any page of it splits it back.  A reservation
+   is free again once its last frame is; when the free lists run dry,
+   free reservations are broken up into ordinary frames before anything
+   gets evicted. */
+#define LARGE_FRAMES (PTSPAN / PGSIZE)   // frames in a 4 MB page
+
+struct reservation {
+  struct list_elem elem;   // in large_free or large_active
+  tid_t tid;               // owner, while active
+  const void *upage;       // 4 MB aligned region it backs, while active
+  struct bitmap *used;     // frames in use
+  bool broken;             // given to the free lists for good
+  bool accessed;           // 4 MB page's accessed bit, last sampled
+};
+
+bool frame_large_pages;                  // set by -large-pages
+static struct reservation *reservations;
+static int reservation_cnt;
+static int large_first;                  // first frame of reservations[0]
+static struct lock large_lock;           // protects reservations
+static struct list large_free;           // reservations nobody has claimed
+static struct list large_active;         // claimed reservations
+static int large_free_cnt;               // length of LARGE_FREE, unlocked
+static unsigned reserve_cnt;             // reservations claimed
+static unsigned promote_cnt;             // regions mapped with a 4 MB page
+
+/* Resident set quotas.  Each process has a soft minimum and maximum
+   number of private frames, set from its working set as estimated,
+   page fault frequency style, once per PFF_WINDOW ticks in which it
+   faults: more than PFF_HIGH faults in the window mean the working set
+   is larger than what is resident, fewer than PFF_LOW mean it is
+   smaller.  A process over its maximum evicts its own pages before
+   anyone else's, the evictor prefers frames of processes over their
+   maximum, and passes over those of processes at or under their
+   minimum, which is at most RSS_MIN_CAP frames, unless nothing else
+   will do.  So a small interactive process keeps its pages while
+   another streams through a large mapping. */
+#define PFF_WINDOW 10            // ticks per fault frequency sample
+#define PFF_HIGH 32              // faults per window, working set grows
+#define PFF_LOW 4                // faults per window, working set shrinks
+#define RSS_MIN_CAP 64           // largest guaranteed resident set
+#define QUOTA_TIER_SPAN 1024     // above any replacement policy score
+
+static unsigned quota_evict_cnt;     // frames over-quota processes gave up
+
+/* Contention statistics, bumped with stat_inc() by threads holding
+   unrelated locks or none. */
+static unsigned evict_cnt;           // frames evicted on demand or by pageout
+static unsigned long long scan_cnt;  // frames examined choosing victims
+static unsigned busy_cnt;            // of those, skipped as locked by others
+static unsigned partition_wait_cnt;  // free list lock found taken
+static unsigned partition_steal_cnt; // frames taken from another list
+
+/* Kernel page of zeroes that every process maps read-only for
+   zero-fill pages it has only read so far.  It is not a user frame,
+   so it is never evicted and pinning it is a no-op. */
+static void *zero_frame;
+
+/* Page-out daemon.  When the number of free frames drops below the low
+   watermark the daemon evicts cold frames until it is back above the
+   high one. */
+#define DEFAULT_LOW_WATERMARK_DIV 32   // low watermark = frames / 32
+#define MIN_LOW_WATERMARK 4
+
+size_t frame_low_watermark = SIZE_MAX;   // set by -vm-lowat
+size_t frame_high_watermark = SIZE_MAX;  // set by -vm-hiwat
+
+static struct lock pageout_lock;       // for pageout_cond
+static struct condition pageout_cond;  // signalled at the low watermark
+
+static struct frame_entry *
+kpage_to_frame_entry (void *kpage)
+{
+  int index = (unsigned) (vtop (kpage) - num_kernel_pages * PGSIZE - 
+                          FREE_PAGES_START_OFFSET) / PGSIZE;
+  return &frame_table[index];
+}
+
+static void * 
+frame_entry_to_kpage (struct frame_entry *entry)
+{
+  int index = ((unsigned) entry - (unsigned) frame_table) / 
+               sizeof (struct frame_entry);
+  return ptov (FREE_PAGES_START_OFFSET) + (num_kernel_pages + index) * PGSIZE;
+}
+
+/* Adds one to the statistics counter *CNT, with interrupts off like
+   the resident set counts in frame_set_owner(), so concurrent updates
+   from threads holding different locks don't get lost. */
+static void
+stat_inc (unsigned *cnt)
+{
+  enum intr_level old_level = intr_disable ();
+  (*cnt)++;
+  intr_set_level (old_level);
+}
+
+/* Returns the free list partition ENTRY belongs to. */
+static struct frame_partition *
+partition_of (struct frame_entry *entry)
+{
+  return &partitions[(entry - frame_table) % FRAME_PARTITIONS];
+}
+
+/* Locks P, counting it if another thread has it. */
+static void
+partition_lock (struct frame_partition *p)
+{
+  if (!lock_try_acquire (&p->lock)) {
+    stat_inc (&partition_wait_cnt);
+    lock_acquire (&p->lock);
+  }
+}
+
+/* Returns the reservation ENTRY belongs to, or NULL if none. */
+static struct reservation *
+reservation_of (struct frame_entry *entry)
+{
+  int i = entry - frame_table - large_first;
+  if (reservations == NULL || i < 0 || i >= reservation_cnt * LARGE_FRAMES)
+    return NULL;
+  struct reservation *r = &reservations[i / LARGE_FRAMES];
+  return r->broken ? NULL : r;
+}
+
+/* Returns the index of R's first frame. */
+static int
+reservation_first (struct reservation *r)
+{
+  return large_first + (r - reservations) * LARGE_FRAMES;
+}
+
+/* Pushes the frames of R whose bits in R's used map are set onto the
+   free lists, taking each free list lock once, and clears the map. */
+static void
+reservation_scatter (struct reservation *r)
+{
+  int first = reservation_first (r);
+  int j;
+  for (j = 0; j < FRAME_PARTITIONS; j++) {
+    struct frame_partition *p = &partitions[j];
+    partition_lock (p);
+    int i;
+    for (i = 0; i < LARGE_FRAMES; i++) {
+      struct frame_entry *entry = &frame_table[first + i];
+      if (partition_of (entry) == p && bitmap_test (r->used, i)) {
+        list_push_front (&p->free, &entry->free_elem);
+        p->free_cnt++;
+      }
+    }
+    lock_release (&p->lock);
+  }
+  bitmap_set_all (r->used, false);
+}
+
+/* Sets up reservations over the 4 MB aligned runs of the frame
+   table.  Returns false if there is no room for any. */
+static bool
+reservation_init (void)
+{
+  uintptr_t start = vtop (frame_entry_to_kpage (&frame_table[0]));
+  large_first = (ROUND_UP (start, PTSPAN) - start) / PGSIZE;
+  if (large_first >= num_user_pages)
+    return false;
+  reservation_cnt = (num_user_pages - large_first) / LARGE_FRAMES;
+  if (reservation_cnt == 0)
+    return false;
+
+  lock_init (&large_lock);
+  list_init (&large_free);
+  list_init (&large_active);
+  reservations = calloc (reservation_cnt, sizeof *reservations);
+  ASSERT (reservations != NULL);
+  int i;
+  for (i = 0; i < reservation_cnt; i++) {
+    reservations[i].used = bitmap_create (LARGE_FRAMES);
+    ASSERT (reservations[i].used != NULL);
+  }
+  return true;
+}
+
+/* Returns the frame of ENTRY, which has just been cleared, to its
+   reservation.  Returns false if ENTRY isn't in one. */
+static bool
+reservation_put (struct frame_entry *entry)
+{
+  struct reservation *r = reservation_of (entry);
+  if (r == NULL)
+    return false;
+
+  lock_acquire (&large_lock);
+  bitmap_reset (r->used, entry - frame_table - reservation_first (r));
+  if (bitmap_none (r->used, 0, LARGE_FRAMES)) {
+    list_remove (&r->elem);
+    list_push_back (&large_free, &r->elem);
+    large_free_cnt++;
+  }
+  lock_release (&large_lock);
+  return true;
+}
+
+/* Breaks up a free reservation into ordinary free frames.  Returns
+   false if there is none. */
+static bool
+reservation_break (void)
+{
+  if (reservations == NULL)
+    return false;
+
+  lock_acquire (&large_lock);
+  struct reservation *r = NULL;
+  if (!list_empty (&large_free)) {
+    r = list_entry (list_pop_front (&large_free), struct reservation, elem);
+    large_free_cnt--;
+    r->broken = true;
+  }
+  lock_release (&large_lock);
+
+  if (r == NULL)
+    return false;
+  bitmap_set_all (r->used, true);
+  reservation_scatter (r);
+  return true;
+}
+
+/* Returns the number of free frames.  Unlocked, so only a snapshot. */
+static int
+frame_free_cnt (void)
+{
+  int cnt = large_free_cnt * LARGE_FRAMES;
+  int i;
+  for (i = 0; i < FRAME_PARTITIONS; i++)
+    cnt += partitions[i].free_cnt;
+  return cnt;
+}
 
 void
 frame_init (size_t user_page_limit)
@@ -29,152 +303,937 @@ frame_init (size_t user_page_limit)
   frame_table = (struct frame_entry *) malloc (sizeof(struct frame_entry) 
                                                * num_user_pages);
   ASSERT (frame_table != NULL);
-  lock_init (&frame_table_lock);
+  zero_frame = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
   int i;
   for (i = 0; i < (int) num_user_pages; i++) {
     struct frame_entry *entry = &frame_table[i]; // used on frame entry access
     lock_init (&entry->lock);
+    entry->thread = NULL;
+    entry->upage = NULL;
+    entry->pin_cnt = 0;
+    entry->state = 0;
+    entry->share = NULL;
+  }
+
+  for (i = 0; i < FRAME_PARTITIONS; i++) {
+    lock_init (&partitions[i].lock);
+    list_init (&partitions[i].free);
+    partitions[i].free_cnt = 0;
   }
+  if (frame_large_pages && !pagedir_enable_large_pages ()) {
+    printf ("large pages: not supported by this CPU, disabled\n");
+    frame_large_pages = false;
+  }
+  if (frame_large_pages && !reservation_init ())
+    frame_large_pages = false;
+
+  void *kpage;
+  while ((kpage = palloc_get_page (PAL_USER)) != NULL) {
+    struct frame_entry *entry = kpage_to_frame_entry (kpage);
+    struct reservation *r = reservation_of (entry);
+    if (r != NULL) {   // sorted out below
+      bitmap_mark (r->used, entry - frame_table - reservation_first (r));
+      continue;
+    }
+    struct frame_partition *p = partition_of (entry);
+    list_push_back (&p->free, &entry->free_elem);
+    p->free_cnt++;
+  }
+
+  /* A reservation needs every one of its frames. */
+  for (i = 0; i < reservation_cnt; i++) {
+    struct reservation *r = &reservations[i];
+    if (bitmap_all (r->used, 0, LARGE_FRAMES)) {
+      bitmap_set_all (r->used, false);
+      list_push_back (&large_free, &r->elem);
+      large_free_cnt++;
+    } else {
+      r->broken = true;
+      reservation_scatter (r);
+    }
+  }
+
+  int free_frames = frame_free_cnt ();
+  size_t low_asked = frame_low_watermark;
+  size_t high_asked = frame_high_watermark;
+  lock_init (&pageout_lock);
+  cond_init (&pageout_cond);
+  if (frame_low_watermark == SIZE_MAX) {
+    frame_low_watermark = free_frames / DEFAULT_LOW_WATERMARK_DIV;
+    if (frame_low_watermark < MIN_LOW_WATERMARK)
+      frame_low_watermark = MIN_LOW_WATERMARK;
+  }
+  if (frame_low_watermark > (size_t) free_frames / 4)
+    frame_low_watermark = free_frames / 4;
+  if (frame_high_watermark == SIZE_MAX)
+    frame_high_watermark = frame_low_watermark * 2;
+  if (frame_high_watermark > (size_t) free_frames / 2)
+    frame_high_watermark = free_frames / 2;
+  if (frame_high_watermark < frame_low_watermark)
+    frame_high_watermark = frame_low_watermark;
+
+  /* Say so if -vm-lowat or -vm-hiwat had to be changed to fit. */
+  if ((low_asked != SIZE_MAX && low_asked != frame_low_watermark) ||
+      (high_asked != SIZE_MAX && high_asked != frame_high_watermark))
+    printf ("page-out: watermarks out of range for %d free frames, "
+            "using low %zu, high %zu\n", free_frames, frame_low_watermark,
+            frame_high_watermark);
 }
 
-static struct frame_entry *
-kpage_to_frame_entry (void *kpage)
+/* Returns the lock that keeps ENTRY's mappings alive while it is being
+   evicted: the owner's exit lock, or the share lock for a frame mapped
+   by several processes. */
+static struct lock *
+owner_lock (struct frame_entry *entry)
 {
-  int index = (unsigned) (vtop (kpage) - num_kernel_pages * PGSIZE - 
-                          FREE_PAGES_START_OFFSET) / PGSIZE;
-  return &frame_table[index];
+  return entry->share != NULL ? &share_lock : &entry->thread->exit_lock;
 }
 
-static void * 
-frame_entry_to_kpage (struct frame_entry *entry)
+/* Returns true if evicting ENTRY's page needs I/O.  Executable pages
+   shared between processes are clean; copy-on-write shares made by
+   fork() hold anonymous data and may have to go to swap. */
+static bool
+frame_dirty (struct frame_entry *entry)
 {
-  int index = ((unsigned) entry - (unsigned) frame_table) / 
-               sizeof (struct frame_entry);
-  return ptov (FREE_PAGES_START_OFFSET) + (num_kernel_pages + index) * PGSIZE;
+  if (entry->share != NULL)
+    return entry->share->inode == NULL;
+  return pagedir_is_dirty (entry->thread->pagedir, entry->upage);
 }
 
-/* chooses frame, updates sup_page_table entries, writes data if needed */
-/* Entering this function you already have the frame table lock and the lock for
- the entry you own*/
-static void * 
-evict (struct sup_page_entry *page_entry, bool pinned)
+/* Returns true if ENTRY's page was accessed since the last call, and
+   clears its accessed bit.  The pages of a 4 MB page share one
+   accessed bit.  Its first page samples and clears it into the
+   reservation, under that frame's lock, and the others return the
+   sample, so that one pass of the clock sees all of them alike. */
+static bool
+frame_accessed (struct frame_entry *entry)
+{
+  if (entry->share != NULL)
+    return share_test_and_clear_accessed (entry->share);
+
+  uint32_t *pd = entry->thread->pagedir;
+  if (pagedir_is_large (pd, entry->upage)) {
+    struct reservation *r = reservation_of (entry);
+    ASSERT (r != NULL);
+    if (((uintptr_t) entry->upage & (PTSPAN - 1)) == 0) {
+      r->accessed = pagedir_is_accessed (pd, entry->upage);
+      if (r->accessed)
+        pagedir_set_accessed (pd, entry->upage, false);
+    }
+    return r->accessed;
+  }
+
+  bool accessed = pagedir_is_accessed (pd, entry->upage);
+  if (accessed)
+    pagedir_set_accessed (pd, entry->upage, false);
+  return accessed;
+}
+
+/* Makes T, which may be NULL, the owner of ENTRY, moving the frame
+   from its old owner's resident set to T's.  An owner may only be
+   changed while its exit lock or the frame is held, so that it can't
+   go away with the frame still counted. */
+static void
+frame_set_owner (struct frame_entry *entry, struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  if (entry->thread != NULL)
+    entry->thread->rss--;
+  if (t != NULL)
+    t->rss++;
+  intr_set_level (old_level);
+  entry->thread = t;
+}
+
+/* Notes a page fault of the current process and, at the end of each
+   fault window, estimates its working set and sets its quotas from
+   it.  Only called from the page fault handler, so that pages brought
+   in for a process by fault-around or the page-in thread don't count
+   as its faults.  Interrupts are off so that the estimate sees RSS as
+   frame_set_owner() leaves it and evictors see consistent quotas. */
+void
+frame_pff_fault (void)
 {
   struct thread *t = thread_current ();
-  struct frame_entry *evict_entry = NULL;
+  int64_t now = timer_ticks ();
+  enum intr_level old_level = intr_disable ();
+  t->pff_faults++;
+  if (now - t->pff_start < PFF_WINDOW) {
+    intr_set_level (old_level);
+    return;
+  }
+
+  int ws = t->rss;
+  if (t->pff_faults > PFF_HIGH)
+    ws += t->pff_faults;
+  else if (t->pff_faults < PFF_LOW)
+    ws -= ws / 4;
+  t->rss_min = ws < RSS_MIN_CAP ? ws : RSS_MIN_CAP;
+  t->rss_max = ws + ws / 4 + PFF_LOW;
+  t->pff_start = now;
+  t->pff_faults = 0;
+  intr_set_level (old_level);
+}
+
+/* Returns how the owner of ENTRY stands against its quotas: 0 if over
+   its maximum, 2 if at or under its minimum, 1 otherwise. */
+static int
+quota_tier (struct frame_entry *entry)
+{
+  if (entry->share != NULL)
+    return 1;
+  struct thread *t = entry->thread;
+  return t->rss > t->rss_max ? 0 : t->rss <= t->rss_min ? 2 : 1;
+}
+
+/* Page replacement policies.  The clock hand and the choice of victim
+   in select_victim() are common to all of them; a policy only rates
+   how cold each frame the hand passes is.  SCORE is called with the
+   frame and its owner lock held, and may sample the accessed bit with
+   frame_accessed() and keep what it likes in the frame's STATE.
+   Frames with lower scores go first and a frame scoring 0 is taken at
+   once; 1 means cold but dirty, taken if no cold clean frame turns up
+   within CLEAN_SCAN_LIMIT frames.  INSTALL sets up STATE for a frame
+   just given a page, DEACTIVATE for one madvise() says is done with. */
+struct frame_policy {
+  const char *name;
+  int (*score) (struct frame_entry *);
+  void (*install) (struct frame_entry *);
+  void (*deactivate) (struct frame_entry *);
+};
+
+static void
+policy_nop (struct frame_entry *entry UNUSED)
+{
+}
+
+/* Clock: a frame whose page was accessed since the hand last came by
+   gets a second chance, any other is taken. */
+static int
+clock_score (struct frame_entry *entry)
+{
+  return frame_accessed (entry) ? 2 : 0;
+}
+
+/* Enhanced second chance: the (accessed, dirty) class of each frame is
+   its score, so unreferenced clean pages go before unreferenced dirty
+   ones, and those before any that were referenced. */
+static int
+second_chance_score (struct frame_entry *entry)
+{
+  return (frame_accessed (entry) ? 2 : 0) | (frame_dirty (entry) ? 1 : 0);
+}
+
+/* Aging: each pass shifts the accessed bit into an 8-bit counter, and
+   the frame with the lowest (age, dirty) is taken, so among equally
+   cold frames a clean one wins and costs no I/O. */
+static int
+aging_score (struct frame_entry *entry)
+{
+  entry->state = (entry->state >> 1) |
+                 (frame_accessed (entry) ? AGE_REFERENCED : 0);
+  return entry->state << 1 | (frame_dirty (entry) ? 1 : 0);
+}
+
+static void
+aging_install (struct frame_entry *entry)
+{
+  entry->state = AGE_REFERENCED;  // grace period until first sweep
+}
+
+static void
+aging_deactivate (struct frame_entry *entry)
+{
+  entry->state = 0;
+}
+
+/* Approximate 2Q: a new page is on probation and is taken if the hand
+   comes round before it is used again.  One that is used again moves
+   to the protected set, where the hand passes it over while it keeps
+   being used and puts it back on probation, rather than taking it,
+   the first time it wasn't, so a one-time scan never pushes out the
+   working set.  The reference that brought a page in doesn't count. */
+#define TWOQ_PROBATION 0
+#define TWOQ_NEW 1
+#define TWOQ_PROTECTED 2
+
+static int
+twoq_score (struct frame_entry *entry)
+{
+  bool accessed = frame_accessed (entry);
+  int score;
+  if (entry->state == TWOQ_NEW) {
+    entry->state = TWOQ_PROBATION;
+    score = 2;
+  } else if (accessed) {
+    entry->state = TWOQ_PROTECTED;
+    score = 4;
+  } else if (entry->state == TWOQ_PROTECTED) {
+    entry->state = TWOQ_PROBATION;
+    score = 2;
+  } else {
+    score = 0;
+  }
+  return score | (frame_dirty (entry) ? 1 : 0);
+}
+
+static void
+twoq_install (struct frame_entry *entry)
+{
+  entry->state = TWOQ_NEW;
+}
+
+static void
+twoq_deactivate (struct frame_entry *entry)
+{
+  entry->state = TWOQ_PROBATION;
+}
+
+static const struct frame_policy policies[] = {
+  {"clock", clock_score, policy_nop, policy_nop},
+  {"second-chance", second_chance_score, policy_nop, policy_nop},
+  {"aging", aging_score, aging_install, aging_deactivate},
+  {"2q", twoq_score, twoq_install, twoq_deactivate},
+};
+
+static const struct frame_policy *policy = &policies[2];  // -vm-policy
+
+/* Selects the page replacement policy called NAME.  Returns false if
+   there is none by that name. */
+bool
+frame_set_policy (const char *name)
+{
+  size_t i;
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (policies[i].name, name)) {
+      policy = &policies[i];
+      return true;
+    }
+  return false;
+}
+
+/* Returns the frame under the clock hand and advances the hand.  The
+   hand is shared by every evicting thread and moved atomically, so
+   concurrent scans look at different frames.  Counts the frame as
+   scanned. */
+static struct frame_entry *
+clock_next (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct frame_entry *entry = &frame_table[clock_hand];
+  scan_cnt++;
+  if (++clock_hand >= num_user_pages)
+    clock_hand = FIRST_FRAME;
+  intr_set_level (old_level);
+  return entry;
+}
+
+/* chooses frame for eviction.
+   The clock hand persists across calls so every frame is looked at
+   equally often.  Each frame the hand passes is scored by the
+   replacement policy; the victim is the frame with the lowest score
+   seen in one revolution, or the first scoring 0.  A cold dirty frame
+   is taken if no cold clean one shows up within CLEAN_SCAN_LIMIT frames.
+   The scan goes on for up to CLOCK_SWEEP_LIMIT revolutions only while
+   nothing evictable has been found.  No table-wide lock is held: only
+   the best frame so far stays locked, and frames locked by anyone else
+   are passed over.
+
+   Scores are ranked by quota_tier() first, so frames of processes
+   over their resident set maximum go first and those of processes
+   under their minimum last.
 
+   Returns the victim with its entry lock and its owner lock (see
+   owner_lock()) held; *TOOK_OWNER_LOCK is false if the caller already
+   held the owner lock, in which case it must not be released for this
+   victim.  Frames whose lock the caller already holds are skipped, and
+   so are shared frames if the caller holds the share lock, since
+   share_evict() has to release it.  If
+   every frame is pinned or busy, retries until one frees up when
+   MUST_SUCCEED is true and returns NULL otherwise.  If ONLY is non-null,
+   only ONLY's private frames are considered, for one revolution, and
+   NULL is returned if none of them will do. */
+static struct frame_entry *
+select_victim (bool must_succeed, bool *took_owner_lock, struct thread *only)
+{
+  bool share_held = lock_held_by_current_thread (&share_lock);
   while (true) {
 
+    struct frame_entry *best = NULL;
+    int best_score = INT_MAX;
+    bool best_took_owner = false;
+    int clean_scan_left = CLEAN_SCAN_LIMIT;
+    int sweep_limit = only != NULL ? 1 : CLOCK_SWEEP_LIMIT;
+
     int i;
-    for (i = 1; i < num_user_pages; i++) {  // frame entries start at 1
-      struct frame_entry *entry = &frame_table[i];
-      if (lock_try_acquire (&entry->lock)) {
-
-        if (entry->thread == NULL) {  // found an empty frame
-          void *kpage = palloc_get_page (PAL_USER);
-          kpage = pg_round_down (kpage);
-          pagedir_set_page (t->pagedir, page_entry->upage, kpage, 
-                            page_entry->writable);
-          entry->thread = t;
-          entry->upage = page_entry->upage;
-          entry->pinned = pinned;
-          lock_release (&frame_table_lock);
-          lock_release (&entry->lock);
-          return kpage;
-        }
+    for (i = 0; i < sweep_limit * num_user_pages; i++) {
+      if (best != NULL &&
+          (i >= num_user_pages ||
+           (best_score % QUOTA_TIER_SPAN == 1 &&
+            best_score < 2 * QUOTA_TIER_SPAN && clean_scan_left-- == 0)))
+        break;  // settle for a cold dirty frame or the best of a revolution
 
-        if (pagedir_is_accessed (entry->thread->pagedir, entry->upage)) {
-          pagedir_set_accessed (entry->thread->pagedir, entry->upage, false);
+      struct frame_entry *entry = clock_next ();
+      if (lock_held_by_current_thread (&entry->lock) ||
+          !lock_try_acquire (&entry->lock)) {
+        stat_inc (&busy_cnt);
+        continue;
+      }
 
-        } else if (!entry->pinned) { // frame neither accessed nor pinned
+      if ((entry->thread == NULL && entry->share == NULL) || 
+          entry->pin_cnt > 0 || // free or pinned frame
+          (only != NULL && (entry->share != NULL || entry->thread != only)) ||
+          (share_held && entry->share != NULL)) {
+        lock_release (&entry->lock);
+        continue;
+      }
 
-          if (!lock_try_acquire (&entry->thread->exit_lock)) { // target exit
-            lock_release (&entry->lock);
-            continue;
-          }
-          evict_entry = entry;
-          lock_release (&frame_table_lock);
-          break;
-        } 
+      struct lock *lock = owner_lock (entry);
+      bool took_owner = false;
+      if (!lock_held_by_current_thread (lock)) {
+        if (!lock_try_acquire (lock)) { // target exit, or share busy
+          stat_inc (&busy_cnt);
+          lock_release (&entry->lock);
+          continue;
+        }
+        took_owner = true;
+      }
 
+      int score = quota_tier (entry) * QUOTA_TIER_SPAN + policy->score (entry);
+
+      if (score >= best_score) {
+        if (took_owner)
+          lock_release (lock);
         lock_release (&entry->lock);
+        continue;
+      }
+
+      if (best != NULL) {
+        if (owner_lock (best) == lock)
+          took_owner = best_took_owner;  // the lock moves to the new best
+        else if (best_took_owner)
+          lock_release (owner_lock (best));
+        lock_release (&best->lock);
       }
+      best = entry;
+      best_score = score;
+      best_took_owner = took_owner;
+
+      if (best_score % QUOTA_TIER_SPAN == 0 &&
+          best_score < 2 * QUOTA_TIER_SPAN)  // cold and clean, take it
+        break;
     }
 
-    if (evict_entry != NULL) { 
+    if (best != NULL) {
+      *took_owner_lock = best_took_owner;
+      return best;
+    }
+
+    if (!must_succeed || only != NULL)
+      return NULL;
+    thread_current ()->vm_stats.pin_waits++;
+    thread_yield ();  // everything pinned or busy, let others make progress
+  }
+}
+
+/* Evicts the page or shared frame in VICTIM, as chosen by
+   select_victim(), and drops its owner lock if TOOK_OWNER_LOCK.
+   share_evict() drops the share lock itself. */
+static void
+evict_victim (struct frame_entry *victim, bool took_owner_lock)
+{
+  stat_inc (&evict_cnt);
+  if (victim->share != NULL) {
+    ASSERT (took_owner_lock);
+    share_evict (victim->share);
+    victim->share = NULL;
+    return;
+  }
+
+  struct lock *lock = owner_lock (victim);
+  page_evict (victim->thread, victim->upage);  
+  frame_set_owner (victim, NULL);
+  if (took_owner_lock)
+    lock_release (lock);
+}
 
-      page_evict (evict_entry->thread, evict_entry->upage);  
-      lock_release (&evict_entry->thread->exit_lock);
+/* chooses frame, updates sup_page_table entries, writes data if needed.
+   A process over its resident set maximum gives up one of its own
+   frames if it can.  Returns the victim with its entry lock held and
+   its old page evicted. */
+static struct frame_entry *
+evict (void)
+{
+  bool took_owner_lock;
+  struct thread *t = thread_current ();
+  struct frame_entry *victim = NULL;
+  if (t->rss >= t->rss_max) {
+    victim = select_victim (false, &took_owner_lock, t);
+    if (victim != NULL)
+      stat_inc (&quota_evict_cnt);
+  }
+  if (victim == NULL)
+    victim = select_victim (true, &took_owner_lock, NULL);
+  if (victim->share != NULL || victim->thread != t)
+    t->vm_stats.stolen++;
+  evict_victim (victim, took_owner_lock);
+  return victim;
+}
+
+/* Gives the locked frame ENTRY at KPAGE to PAGE_ENTRY and maps it in
+   its owner's page directory, then unlocks ENTRY. */
+static void
+frame_install (struct frame_entry *entry, void *kpage, 
+               struct sup_page_entry *page_entry, bool pinned)
+{
+  struct thread *t = page_entry->thread;
+
+  frame_set_owner (entry, t);
+  entry->upage = page_entry->upage;
+  entry->pin_cnt = pinned ? 1 : 0;
+  policy->install (entry);
+  entry->share = NULL;
+
+  pagedir_set_page (t->pagedir, page_entry->upage, kpage, 
+                    page_entry->writable);
+
+  lock_release (&entry->lock);
+}
+
+/* Takes a frame off the free lists, trying the current thread's own
+   partition first.  Returns it locked, or NULL if none is free. */
+static struct frame_entry *
+frame_alloc (void)
+{
+  int home = thread_current ()->tid % FRAME_PARTITIONS;
 
-      evict_entry->thread = t;
-      evict_entry->upage = page_entry->upage;
-      evict_entry->pinned = pinned;
+  int i;
+  for (i = 0; i < FRAME_PARTITIONS; i++) {
+    struct frame_partition *p = &partitions[(home + i) % FRAME_PARTITIONS];
+    if (p->free_cnt == 0)
+      continue;
 
-      lock_release (&evict_entry->lock);
-      return frame_entry_to_kpage (evict_entry);
+    struct frame_entry *entry = NULL;
+    partition_lock (p);
+    if (!list_empty (&p->free)) {
+      entry = list_entry (list_pop_front (&p->free), struct frame_entry,
+                          free_elem);
+      p->free_cnt--;
+      if (i != 0)
+        stat_inc (&partition_steal_cnt);
     }
+    lock_release (&p->lock);
 
+    if (entry != NULL) {
+      lock_acquire (&entry->lock);  // an evictor may be peeking at it
+      return entry;
+    }
   }
+  return NULL;
+}
+
+/* Wakes the page-out daemon if free frames have run low. */
+static void
+pageout_check (void)
+{
+  if ((size_t) frame_free_cnt () >= frame_low_watermark)
+    return;
+  lock_acquire (&pageout_lock);
+  cond_signal (&pageout_cond, &pageout_lock);
+  lock_release (&pageout_lock);
 }
 
 /* allocates page in physical memory for a specific thread's virtual memory 
-   deals with eviction if necessary.
+   deals with eviction if necessary.  The frame's old contents are left
+   for the caller to overwrite.
 */
 void *
 frame_add (struct sup_page_entry *page_entry, bool pinned) 
 {
-  struct thread *t = thread_current ();
-  lock_acquire (&frame_table_lock);
+  struct frame_entry *entry = frame_alloc ();
+  if (entry == NULL && reservation_break ())
+    entry = frame_alloc ();
+  pageout_check ();
+  if (entry == NULL)
+    entry = evict ();
 
-  void *kpage = page_entry->zeroed ? palloc_get_page (PAL_USER | PAL_ZERO)
-                                   : palloc_get_page (PAL_USER); 
-  if (kpage == NULL) {
+  void *kpage = frame_entry_to_kpage (entry);
+  frame_install (entry, kpage, page_entry, pinned);
+  return kpage;
+}
 
-    kpage = evict (page_entry, pinned);
-    if (pagedir_get_page (t->pagedir, page_entry->upage) == NULL)
-      pagedir_set_page (t->pagedir, page_entry->upage, kpage, 
-                        page_entry->writable);
+/* Like frame_add(), but only hands out a frame that is free and would
+   not take the pool below the low watermark; never evicts.  Returns
+   NULL otherwise.  Used for speculative page-ins such as fault-around. */
+void *
+frame_add_if_free (struct sup_page_entry *page_entry, bool pinned)
+{
+  if ((size_t) frame_free_cnt () <= frame_low_watermark)
+    return NULL;
 
-  } else {
+  struct frame_entry *entry = frame_alloc ();
+  if (entry == NULL)
+    return NULL;
+
+  void *kpage = frame_entry_to_kpage (entry);
+  frame_install (entry, kpage, page_entry, pinned);
+  return kpage;
+}
+
+/* Maps the region of T at UPAGE, which R backs and whose frames are
+   all in use, with a 4 MB page if each of them still holds the page
+   of T at its own offset.  Gives up if anything is busy, since the
+   caller may hold a sup page entry lock. */
+static void
+reservation_promote (struct reservation *r, struct thread *t,
+                     const void *upage)
+{
+  bool took_exit_lock = false;
+  if (!lock_held_by_current_thread (&t->exit_lock)) {
+    if (!lock_try_acquire (&t->exit_lock))  // evictors are at work
+      return;
+    took_exit_lock = true;
+  }
+
+  /* With T's exit lock held nothing can take these frames away. */
+  int first = reservation_first (r);
+  bool ok = true;
+  int i;
+  for (i = 0; ok && i < LARGE_FRAMES; i++) {
+    struct frame_entry *entry = &frame_table[first + i];
+    if (!lock_try_acquire (&entry->lock)) {
+      ok = false;
+      break;
+    }
+    ok = (entry->thread == t && entry->share == NULL &&
+          entry->upage == (const uint8_t *) upage + i * PGSIZE);
+    lock_release (&entry->lock);
+  }
+  if (ok && pagedir_promote (t->pagedir, upage))
+    stat_inc (&promote_cnt);
 
-    pagedir_set_page (t->pagedir, page_entry->upage, kpage, 
-                      page_entry->writable);
+  if (took_exit_lock)
+    lock_release (&t->exit_lock);
+}
 
-    kpage = pg_round_down (kpage);
-    struct frame_entry *frame_entry = kpage_to_frame_entry (kpage);
-    lock_acquire (&frame_entry->lock);
-    lock_release (&frame_table_lock);
+/* Like frame_add(), for a page of a 4 MB aligned region that one
+   address space range covers: gives it the frame at its own offset in
+   the reservation backing the region, claiming a free reservation if
+   the region has none, and maps the region with a 4 MB page once all
+   of it is in.  Never evicts.  Returns NULL if large pages are off or
+   that frame isn't available, for the caller to fall back on
+   frame_add(). */
+void *
+frame_add_reserved (struct sup_page_entry *page_entry, bool pinned)
+{
+  if (!frame_large_pages)
+    return NULL;
 
-    frame_entry->thread = thread_current ();
-    frame_entry->upage = page_entry->upage;
-    frame_entry->pinned = pinned;
+  struct thread *t = page_entry->thread;
+  const void *upage = (const void *) ((uintptr_t) page_entry->upage
+                                      & ~(uintptr_t) (PTSPAN - 1));
+  size_t ofs = pg_no (page_entry->upage) - pg_no (upage);
 
-    lock_release (&frame_entry->lock);
+  lock_acquire (&large_lock);
+  struct reservation *r = NULL;
+  struct list_elem *e;
+  for (e = list_begin (&large_active); e != list_end (&large_active);
+       e = list_next (e)) {
+    struct reservation *a = list_entry (e, struct reservation, elem);
+    if (a->tid == t->tid && a->upage == upage) {
+      r = a;
+      break;
+    }
+  }
+  bool claimed = false;
+  if (r == NULL && !list_empty (&large_free)) {
+    r = list_entry (list_pop_front (&large_free), struct reservation, elem);
+    large_free_cnt--;
+    r->tid = t->tid;
+    r->upage = upage;
+    r->accessed = true;
+    list_push_back (&large_active, &r->elem);
+    reserve_cnt++;
+    claimed = true;
+  }
 
+  struct frame_entry *entry = NULL;
+  bool full = false;
+  if (r != NULL && !bitmap_test (r->used, ofs)) {
+    bitmap_mark (r->used, ofs);
+    entry = &frame_table[reservation_first (r) + ofs];
+    full = bitmap_all (r->used, 0, LARGE_FRAMES);
   }
+  lock_release (&large_lock);
+
+  if (claimed)
+    pageout_check ();
+  if (entry == NULL)
+    return NULL;
 
+  lock_acquire (&entry->lock);  // an evictor may be peeking at it
+  void *kpage = frame_entry_to_kpage (entry);
+  frame_install (entry, kpage, page_entry, pinned);
+  if (full)
+    reservation_promote (r, t, upage);
   return kpage;
 }
 
+/* Marks ENTRY free.  ENTRY's lock must be held. */
+static void
+frame_clear (struct frame_entry *entry)
+{
+  frame_set_owner (entry, NULL);
+  entry->upage = NULL;
+  entry->pin_cnt = 0;
+  entry->state = 0;
+  entry->share = NULL;
+}
+
+/* Returns ENTRY's frame to its free list.  ENTRY's lock must be held. */
+static void
+frame_release (struct frame_entry *entry)
+{
+  frame_clear (entry);
+  if (reservation_put (entry))
+    return;
+
+  struct frame_partition *p = partition_of (entry);
+  partition_lock (p);
+  list_push_front (&p->free, &entry->free_elem);
+  p->free_cnt++;
+  lock_release (&p->lock);
+}
+
 void
 frame_remove (void *kpage)
 {
   struct frame_entry *entry = kpage_to_frame_entry (kpage);
 
   lock_acquire (&entry->lock);
-  
-  palloc_free_page (kpage);
-  entry->upage = entry->thread = NULL;
-  entry->pinned = false;
+  frame_release (entry);
+  lock_release (&entry->lock);
+}
+
+/* Frees the CNT frames in KPAGES like frame_remove(), taking each
+   free list lock at most once.  Overwrites KPAGES. */
+void
+frame_remove_multiple (void **kpages, size_t cnt)
+{
+  /* Frames that went back to their reservation are done with.  Keep
+     the others at the front of KPAGES: once reservation_put() has
+     returned, the reservation may be broken up onto the free lists,
+     so reservation_of() no longer tells them apart. */
+  size_t free_cnt = 0;
+  size_t i;
+  for (i = 0; i < cnt; i++) {
+    struct frame_entry *entry = kpage_to_frame_entry (kpages[i]);
+    lock_acquire (&entry->lock);
+    frame_clear (entry);
+    if (!reservation_put (entry))
+      kpages[free_cnt++] = kpages[i];
+    lock_release (&entry->lock);
+  }
+
+  int j;
+  for (j = 0; j < FRAME_PARTITIONS; j++) {
+    struct frame_partition *p = &partitions[j];
+    bool locked = false;
+    for (i = 0; i < free_cnt; i++) {
+      struct frame_entry *entry = kpage_to_frame_entry (kpages[i]);
+      if (partition_of (entry) != p)
+        continue;
+      if (!locked) {
+        partition_lock (p);
+        locked = true;
+      }
+      list_push_front (&p->free, &entry->free_elem);
+      p->free_cnt++;
+    }
+    if (locked)
+      lock_release (&p->lock);
+  }
+}
+
+/* Evicts up to PAGE_EVICT_CLUSTER cold frames in one batch, so that
+   anonymous victims go to swap as a single run of slots, and returns
+   them to the pool.  Stops early once FREE_FRAMES would reach TARGET.
+   Victims that page_evict_multiple() leaves alone because their owner
+   is busy stay with it.  Returns the number of frames freed. */
+static int
+pageout_cluster (size_t target)
+{
+  struct frame_entry *victims[PAGE_EVICT_CLUSTER];
+  bool took_owner_locks[PAGE_EVICT_CLUSTER];
+  struct lock *owner_locks[PAGE_EVICT_CLUSTER];
+  struct thread *owners[PAGE_EVICT_CLUSTER];
+  const void *upages[PAGE_EVICT_CLUSTER];
+  int private_victims[PAGE_EVICT_CLUSTER];  // index in VICTIMS
+  bool evicted[PAGE_EVICT_CLUSTER];
+  bool kept[PAGE_EVICT_CLUSTER];
+  int cnt = 0;
+  int private_cnt = 0;
+
+  while (cnt < PAGE_EVICT_CLUSTER) {
+    if ((size_t) frame_free_cnt () + cnt >= target)
+      break;
+
+    struct frame_entry *victim = select_victim (false, 
+                                                &took_owner_locks[cnt], NULL);
+    if (victim == NULL)
+      break;
+    victims[cnt] = victim;
+    owner_locks[cnt] = owner_lock (victim);
+    kept[cnt] = false;
+
+    if (victim->share != NULL) {  // not clustered, evict right away
+      share_evict (victim->share);  // drops the share lock
+      victim->share = NULL;
+      took_owner_locks[cnt] = false;
+    } else {
+      owners[private_cnt] = victim->thread;
+      upages[private_cnt] = victim->upage;
+      private_victims[private_cnt] = cnt;
+      private_cnt++;
+    }
+    cnt++;
+  }
+
+  page_evict_multiple (owners, upages, private_cnt, evicted);
+
+  int i;
+  for (i = 0; i < private_cnt; i++)
+    kept[private_victims[i]] = !evicted[i];
+  for (i = 0; i < cnt; i++)
+    if (!kept[i])
+      frame_set_owner (victims[i], NULL);
+  for (i = 0; i < cnt; i++) {
+    if (took_owner_locks[i])
+      lock_release (owner_locks[i]);
+  }
+  int freed = 0;
+  for (i = 0; i < cnt; i++) {
+    if (!kept[i]) {
+      frame_release (victims[i]);
+      stat_inc (&evict_cnt);
+      freed++;
+    }
+    lock_release (&victims[i]->lock);
+  }
+  return freed;
+}
+
+/* Body of the page-out daemon.  Sleeps until frame_add() notices the
+   free frame count has dropped below the low watermark, then evicts
+   cold frames back to the pool until the high watermark is reached.
+   Dirty victims are written out here, so faulting threads usually find
+   a free frame and skip the swap or file write on their own path. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+  lock_acquire (&pageout_lock);
+  while (true) {
+    /* frame_add() signals on every allocation below the low watermark,
+       so a missed wakeup only delays us until the next one. */
+    cond_wait (&pageout_cond, &pageout_lock);
+
+    while ((size_t) frame_free_cnt () < frame_high_watermark) {
+      lock_release (&pageout_lock);
+      int freed = pageout_cluster (frame_high_watermark);
+      lock_acquire (&pageout_lock);
+      if (freed == 0)
+        break;    // everything pinned, wait for the next wakeup
+    }
+  }
+}
+
+/* Starts the page-out daemon.  Must be called after the thread system
+   and swap are up, since the daemon evicts to swap. */
+void
+frame_start_pageout (void)
+{
+  if (frame_low_watermark == 0)
+    return;
+  thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+/* Prints frame allocation and contention statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %s replacement, %u evicted, %llu scanned for victims, "
+          "%u found busy, %u free list waits, %u free list steals, "
+          "%u given up over quota\n",
+          policy->name, evict_cnt, scan_cnt, busy_cnt, partition_wait_cnt,
+          partition_steal_cnt, quota_evict_cnt);
+  if (frame_large_pages)
+    printf ("Large pages: %u reservations claimed, %u promoted, %u split\n",
+            reserve_cnt, promote_cnt, pagedir_split_cnt ());
+}
+
+/* Returns the shared zero frame. */
+void *
+frame_zero (void)
+{
+  return zero_frame;
+}
+
+/* Hands the frame at KPAGE, which the caller has mapped, over to
+   SHARE.  Pins already on it stay.  Must be locked with share
+   lock. */
+void
+frame_set_share (void *kpage, struct page_share *share)
+{
+  struct frame_entry *entry = kpage_to_frame_entry (kpage);
+
+  lock_acquire (&entry->lock);
+  frame_set_owner (entry, NULL);
+  entry->upage = NULL;
+  entry->share = share;
+  lock_release (&entry->lock);
+}
 
+/* Drops one pin from the frame at KPAGE, for a caller that got it
+   pinned from frame_add() but may not map it in its own page
+   directory. */
+void
+frame_unpin_kpage (void *kpage)
+{
+  struct frame_entry *entry = kpage_to_frame_entry (kpage);
+
+  lock_acquire (&entry->lock);
+  ASSERT (entry->pin_cnt > 0);
+  entry->pin_cnt--;
+  lock_release (&entry->lock);
+}
+
+/* Gives the frame at KPAGE, which has just left a share, back to
+   UPAGE of T as a private frame, with one more pin if PINNED.  Must
+   be locked with share lock. */
+void
+frame_set_private (void *kpage, struct thread *t, const void *upage,
+                   bool pinned)
+{
+  struct frame_entry *entry = kpage_to_frame_entry (kpage);
+
+  lock_acquire (&entry->lock);
+  frame_set_owner (entry, t);
+  entry->upage = upage;
+  entry->share = NULL;
+  if (pinned)
+    entry->pin_cnt++;
   lock_release (&entry->lock);
 }
 
 /*  This function will pin or unpin upage to the frame table. This 
     memory cannot be accessed by another thread until it is unpinned. 
+    Pins are counted, since every process mapping a shared frame may
+    pin it at once, and each unpin drops one.
+    If WAIT is false, gives up rather than wait for the frame's lock.
 */
 static bool
-set_pin_status (const void *upage, bool pinned)
+set_pin_status (const void *upage, bool pinned, bool wait)
 {
   struct thread *t = thread_current();
   void *kpage = pagedir_get_page (t->pagedir, upage);
@@ -182,27 +1241,94 @@ set_pin_status (const void *upage, bool pinned)
     return false;
   
   kpage = pg_round_down (kpage);
+  if (kpage == zero_frame)
+    return true;
   struct frame_entry *entry = kpage_to_frame_entry (kpage);
-  lock_acquire (&entry->lock);
+  if (!wait && !lock_try_acquire (&entry->lock))
+    return false;
+  else if (wait)
+    lock_acquire (&entry->lock);
 
-  if (entry->thread != thread_current ()) {
+  /* Eviction unmaps a frame from everyone using it while holding its
+     lock, so if UPAGE still maps here the frame is still ours. */
+  if (pagedir_get_page (t->pagedir, pg_round_down (upage)) != kpage) {
     lock_release (&entry->lock);
     return false;
   }
 
-  entry->pinned = pinned; 
+  if (pinned)
+    entry->pin_cnt++;
+  else {
+    ASSERT (entry->pin_cnt > 0);
+    entry->pin_cnt--;
+  }
   lock_release (&entry->lock);
   return true;
 }
 
+/* Makes the private frame T maps at UPAGE look unreferenced, so the
+   evictor takes it ahead of frames still in use.  Does nothing if
+   UPAGE isn't mapped to a private frame or the frame is busy, since
+   the caller may hold a sup page entry lock an evictor of the frame
+   is waiting for. */
+void
+frame_deactivate (struct thread *t, const void *upage)
+{
+  void *kpage = pagedir_get_page (t->pagedir, upage);
+  if (kpage == NULL || kpage == zero_frame)
+    return;
+
+  struct frame_entry *entry = kpage_to_frame_entry (kpage);
+  if (!lock_try_acquire (&entry->lock))
+    return;
+  if (entry->share == NULL && entry->thread == t && entry->upage == upage) {
+    policy->deactivate (entry);
+    pagedir_set_accessed (t->pagedir, upage, false);
+  }
+  lock_release (&entry->lock);
+}
+
 bool
 frame_pin (const void *upage)
 {
-  return set_pin_status (upage, true);
+  return set_pin_status (upage, true, true);
+}
+
+/* Like frame_pin(), for callers holding UPAGE's sup page entry lock:
+   an evictor that has claimed the frame may be waiting for that lock,
+   so a busy frame counts as being evicted and false is returned. */
+bool
+frame_try_pin (const void *upage)
+{
+  return set_pin_status (upage, true, false);
 }
 
 bool
 frame_unpin (const void *upage) 
 {
-  return set_pin_status (upage, false);
+  return set_pin_status (upage, false, true);
+}
+
+/* Pins the frames the current thread maps at the pages from START up
+   to END, stopping at the first page that is not mapped, or not
+   mapped writable if WRITE.  Returns that page, or END if all of them
+   were pinned. */
+const void *
+frame_pin_range (const void *start, const void *end, bool write)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  const void *upage;
+  for (upage = start; upage < end; upage += PGSIZE)
+    if ((write && !pagedir_is_writable (pd, upage)) || !frame_pin (upage))
+      break;
+  return upage;
+}
+
+/* Unpins the frames the current thread maps in [START, END). */
+void
+frame_unpin_range (const void *start, const void *end)
+{
+  const void *upage;
+  for (upage = start; upage < end; upage += PGSIZE)
+    frame_unpin (upage);
 }
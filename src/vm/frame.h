@@ -4,17 +4,48 @@
 #include "threads/thread.h"
 #include "vm/page.h"
 
+struct page_share;
+
 struct frame_entry {
   struct lock lock;
   struct thread *thread;  // to access the thread's pagedir
   const void *upage;      // to access the entry in thread's pagedir
-  bool pinned;         //If true, pinned by the kernel, do not evict
+  int pin_cnt;         // pins by the kernel, evictable only at 0
+  uint8_t state;       // replacement policy's, e.g. an aging counter
+  struct page_share *share;  // if non-null, mapped by all of share's mappers
+                             // and thread and upage are unused
+  struct list_elem free_elem;  // element in a free list while free
 };
  
+/* Free frame watermarks for the page-out daemon, in pages.
+   Left at SIZE_MAX, frame_init() picks defaults from the pool size. */
+extern size_t frame_low_watermark;
+extern size_t frame_high_watermark;
+
+/* If true, set by -large-pages, 4 MB aligned regions of the user pool
+   are reserved for and mapped as 4 MB pages. */
+extern bool frame_large_pages;
+
+bool frame_set_policy (const char *name);
 void frame_init (size_t user_page_limit);
+void frame_start_pageout (void);
+void frame_print_stats (void);
+void frame_pff_fault (void);
 void *frame_add (struct sup_page_entry *page_entry, bool pinned);
+void *frame_add_if_free (struct sup_page_entry *page_entry, bool pinned);
+void *frame_add_reserved (struct sup_page_entry *page_entry, bool pinned);
 void frame_remove (void *kpage);
+void frame_remove_multiple (void **kpages, size_t cnt);
+void frame_set_share (void *kpage, struct page_share *share);
+void frame_unpin_kpage (void *kpage);
+void frame_set_private (void *kpage, struct thread *t, const void *upage,
+                        bool pinned);
+void *frame_zero (void);
+void frame_deactivate (struct thread *t, const void *upage);
 bool frame_pin (const void *upage);
+bool frame_try_pin (const void *upage);
 bool frame_unpin (const void *upage);
+const void *frame_pin_range (const void *start, const void *end, bool write);
+void frame_unpin_range (const void *start, const void *end);
 
 #endif
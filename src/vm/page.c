@@ -5,12 +5,18 @@
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/pagein.h"
+#include "vm/share.h"
 #include "vm/swap.h"
+#include "vm/vma.h"
+
+bool page_stats_on_exit;   // set by -vm-stats
 
 static unsigned 
 page_hash_hash_func (const struct hash_elem *e, void *aux UNUSED)
@@ -38,36 +44,46 @@ page_init ()
   return sup_page_table;
 }
 
-/* map a page to user virtual memory, but not physical memory */
-void
-page_add_entry (struct hash *sup_page_table, const void *upage, void *kpage,
-                int page_type, int page_loc, int swap_index, 
-                int page_read_bytes, struct file *file, int file_offset, 
-                bool zeroed, bool writable)
+/* Adds a range of PAGE_CNT pages at START to the current process's
+   address space, backed by READ_BYTES bytes of FILE from OFFSET and
+   zeroes after that.  No memory is set aside for the pages until they
+   are touched.  Returns false if the range overlaps another one or
+   memory runs out. */
+bool
+page_add_range (const void *start, size_t page_cnt, int page_type,
+                struct file *file, off_t offset, size_t read_bytes,
+                bool writable)
 {
   struct thread *t = thread_current ();
   lock_acquire (&t->sup_page_table_lock);
-  
-  upage = pg_round_down (upage); 
-  struct sup_page_entry *entry = malloc (sizeof(struct sup_page_entry));
-  ASSERT (entry != NULL);
-
-  lock_init (&entry->lock);
-  entry->upage = upage;
-  entry->kpage = kpage;
-  entry->page_loc = page_loc;
-  entry->page_type = page_type;
-  entry->swap_index = swap_index;
-  entry->page_read_bytes = page_read_bytes;
-  entry->file = file;
-  entry->file_offset = file_offset;
-  entry->zeroed = zeroed;
-  entry->writable = writable;
-  entry->written = false; // used for executables swapping in and out multiple times
+  bool success = vma_add (t, start, page_cnt, page_type, file, offset,
+                          read_bytes, writable) != NULL;
+  lock_release (&t->sup_page_table_lock);
+  return success;
+}
 
-  hash_insert (sup_page_table, &entry->elem);
+/* Grows the current process's stack down to UPAGE.  Returns false if
+   the stack can't grow that far. */
+bool
+page_grow_stack (const void *upage)
+{
+  struct thread *t = thread_current ();
+  lock_acquire (&t->sup_page_table_lock);
+  bool success = vma_grow_stack (t, upage);
+  lock_release (&t->sup_page_table_lock);
+  return success;
+}
 
-  lock_release (&t->sup_page_table_lock); //safe because of large lock
+/* Returns true if no range of the current process overlaps
+   [START, END). */
+bool
+page_range_free (const void *start, const void *end)
+{
+  struct thread *t = thread_current ();
+  lock_acquire (&t->sup_page_table_lock);
+  bool range_free = !vma_overlaps (t, start, end);
+  lock_release (&t->sup_page_table_lock);
+  return range_free;
 }
 
 //Must be locked with sup page table lock
@@ -82,214 +98,962 @@ get_sup_page_entry (struct thread *t, const void *upage)
   return (struct sup_page_entry *) hash_entry (e, struct sup_page_entry, elem); 
 }
 
-void 
-page_remove_entry (void *upage)
+/* Creates T's sup page entry for UPAGE in VMA, which covers it.  The
+   entry copies what it needs of VMA, so eviction never has to look at
+   a range that munmap() may be tearing down.  Must be locked with sup
+   page table lock. */
+static struct sup_page_entry *
+create_entry (struct thread *t, struct vma *vma, const void *upage)
 {
-  struct thread *t = thread_current ();
-  lock_acquire (&t->sup_page_table_lock); //Since freeing cannot use small lock
-  
-  upage = pg_round_down (upage); 
-  struct sup_page_entry *entry = get_sup_page_entry (t, upage);  
+  struct sup_page_entry *entry = malloc (sizeof(struct sup_page_entry));
+  ASSERT (entry != NULL);
 
-  hash_delete (t->sup_page_table, &entry->elem);
-  free (entry);
+  size_t ofs = (const char *) upage - (const char *) vma->start;
+  size_t read_bytes = 0;
+  if (ofs < vma->read_bytes)
+    read_bytes = vma->read_bytes - ofs < PGSIZE ? vma->read_bytes - ofs 
+                                                : PGSIZE;
 
-  lock_release (&t->sup_page_table_lock);
+  lock_init (&entry->lock);
+  entry->upage = upage;
+  entry->kpage = NULL;
+  entry->page_loc = UNMAPPED;
+  entry->page_type = vma->page_type;
+  entry->swap_index = -1;
+  entry->page_read_bytes = read_bytes;
+  entry->file = vma->file;
+  entry->file_offset = vma->offset + ofs;
+  entry->zeroed = vma->page_type == _STACK;
+  entry->writable = vma->writable;
+  entry->written = false; // used for executables swapping in and out multiple times
+  entry->thread = t;
+  entry->share = NULL;
+
+  hash_insert (t->sup_page_table, &entry->elem);
+  return entry;
 }
 
-/* Updates the sup page table and pagedir during eviction.
-   Entering page evict have evicting thread's supp entry lock and the
-   frame entry lock for thread being evicted as well as its exit lock.
+/* Returns T's sup page entry for page-aligned UPAGE, creating it from
+   the covering range on first touch, or NULL if no range covers UPAGE.
+   Must be locked with sup page table lock. */
+static struct sup_page_entry *
+get_or_create_entry (struct thread *t, const void *upage)
+{
+  struct sup_page_entry *entry = get_sup_page_entry (t, upage);
+  if (entry == NULL) {
+    struct vma *vma = vma_find (t, upage);
+    if (vma != NULL)
+      entry = create_entry (t, vma, upage);
+  }
+  return entry;
+}
 
-   page evict must acquire the evicted supp entry lock, and release the 
-   supp page table lock before doing I/O */
-void
-page_evict (struct thread *t, const void *upage)
+/* Returns true if ENTRY, T's page of a memory-mapped file, is in
+   memory with changes not yet written back.  Locked with ENTRY's lock
+   or T's exit lock. */
+static bool
+file_dirty (struct thread *t, struct sup_page_entry *entry)
+{
+  return entry->page_type == _FILE && entry->writable &&
+         entry->page_loc == MAIN_MEMORY &&
+         pagedir_is_dirty (t->pagedir, entry->upage);
+}
+
+/* Writes the part of KPAGE that belongs to ENTRY's file back to it. */
+static void
+write_file_page (struct sup_page_entry *entry, const void *kpage)
 {
+  file_write_at (entry->file, kpage, entry->page_read_bytes,
+                 entry->file_offset);
+}
+
+/* Starts evicting UPAGE from T: unmaps it, locks its sup page entry and
+   writes dirty file pages back.  Returns the locked entry; if the page
+   has to go to swap, sets *NEEDS_SWAP and leaves the write and the rest
+   of the bookkeeping to the caller, otherwise the entry is final.
+   Unless MAY_BLOCK, returns NULL without touching the page if T's sup
+   page table lock is taken, since a caller holding other entries' locks
+   must not wait for it: T may hold it while waiting for one of those. */
+static struct sup_page_entry *
+evict_begin (struct thread *t, const void *upage, bool *needs_swap,
+             bool may_block)
+{
+  if (may_block)
+    lock_acquire (&t->sup_page_table_lock);
+  else if (!lock_try_acquire (&t->sup_page_table_lock))
+    return NULL;
   pagedir_clear_page (t->pagedir, upage); // t cannot access during evict
 
-  lock_acquire (&t->sup_page_table_lock);
   struct sup_page_entry *entry = get_sup_page_entry (t, upage);   
   lock_acquire (&entry->lock);
   lock_release (&t->sup_page_table_lock);
+  t->vm_stats.evicted++;
 
+  *needs_swap = false;
   if (entry->page_type == _STACK) {
 
-    entry->swap_index = swap_write_page (entry->kpage);
-    entry->page_loc = SWAP_DISK;
+    *needs_swap = true;
 
   } else if (entry->page_type == _EXEC) {
 
     if (entry->writable && (pagedir_is_dirty (t->pagedir, upage) || entry->written)) {
       entry->written = true;
-      entry->swap_index = swap_write_page (entry->kpage);
-      entry->page_loc = SWAP_DISK;
+      *needs_swap = true;
     } else {
       entry->page_loc = UNMAPPED;
     }
 
   } else {
     
-    if (entry->writable && (pagedir_is_dirty (t->pagedir, upage) || entry->written)) {
-      entry->written = true;
-      lock_acquire (&filesys_lock);
-      file_write_at (entry->file, entry->kpage, PGSIZE, entry->file_offset);
-      lock_release (&filesys_lock);
+    if (file_dirty (t, entry)) {
+      write_file_page (entry, entry->kpage);
     }
     entry->page_loc = UNMAPPED;
 
   }
 
+  if (!*needs_swap)
+    entry->kpage = NULL;
+  return entry;
+}
+
+/* Records that ENTRY now lives in swap slot SWAP_INDEX. */
+static void
+evict_finish_swap (struct sup_page_entry *entry, int swap_index)
+{
+  entry->swap_index = swap_index;
+  entry->page_loc = SWAP_DISK;
   entry->kpage = NULL;
+  entry->thread->vm_stats.swap_outs++;
+}
+
+/* Updates the sup page table and pagedir during eviction.
+   Entering page evict have evicting thread's supp entry lock and the
+   frame entry lock for thread being evicted as well as its exit lock.
+
+   page evict must acquire the evicted supp entry lock, and release the 
+   supp page table lock before doing I/O */
+void
+page_evict (struct thread *t, const void *upage)
+{
+  bool needs_swap;
+  struct sup_page_entry *entry = evict_begin (t, upage, &needs_swap, true);
+
+  if (needs_swap)
+    evict_finish_swap (entry, swap_write_page (entry->kpage));
 
   lock_release (&entry->lock);
 }
 
+/* Evicts the CNT pages UPAGES[i] of THREADS[i] like page_evict(), with
+   the same locking requirements for each page.  Pages bound for swap
+   are written together as one cluster of consecutive slots.  Once one
+   page is under way, a page whose owner's sup page table lock is taken
+   is left alone; EVICTED[i] says whether UPAGES[i] was evicted. */
+void
+page_evict_multiple (struct thread **threads, const void **upages, int cnt,
+                     bool *evicted)
+{
+  struct sup_page_entry *entries[PAGE_EVICT_CLUSTER];
+  struct sup_page_entry *swap_entries[PAGE_EVICT_CLUSTER];
+  void *swap_pages[PAGE_EVICT_CLUSTER];
+  int swap_indices[PAGE_EVICT_CLUSTER];
+  int swap_cnt = 0;
+
+  ASSERT (cnt <= PAGE_EVICT_CLUSTER);
+
+  int entry_cnt = 0;
+  int i;
+  for (i = 0; i < cnt; i++) {
+    bool needs_swap;
+    struct sup_page_entry *entry = evict_begin (threads[i], upages[i],
+                                                &needs_swap, entry_cnt == 0);
+    evicted[i] = entry != NULL;
+    if (entry == NULL)
+      continue;
+    entries[entry_cnt++] = entry;
+    if (needs_swap) {
+      swap_entries[swap_cnt] = entry;
+      swap_pages[swap_cnt] = entry->kpage;
+      swap_cnt++;
+    }
+  }
+
+  swap_write_pages (swap_pages, swap_cnt, swap_indices);
+  for (i = 0; i < swap_cnt; i++)
+    evict_finish_swap (swap_entries[i], swap_indices[i]);
+
+  for (i = 0; i < entry_cnt; i++)
+    lock_release (&entries[i]->lock);
+}
+
+/* Reads ENTRY's file-backed contents into KPAGE and zeroes the rest. */
+static void
+read_file_page (struct sup_page_entry *entry, void *kpage)
+{
+  file_read_at (entry->file, kpage, entry->page_read_bytes,
+                entry->file_offset);
+  memset ((char *) kpage + entry->page_read_bytes, 0, 
+          PGSIZE - entry->page_read_bytes);
+}
+
+/* Returns true if ENTRY's page would be filled with zeroes on its next
+   map: a stack page never written out to swap, or an executable page
+   lying entirely in the BSS. */
+static bool
+zero_fill (const struct sup_page_entry *entry)
+{
+  if (entry->page_loc != UNMAPPED)
+    return false;
+  return entry->page_type == _STACK || 
+         (entry->page_type == _EXEC && entry->page_read_bytes == 0);
+}
+
+/* Fault-around.  After a file or executable page at UPAGE has been read
+   in for FAULTED, maps the following not-yet-present pages backed by
+   the same file, as long as frames are free; it never evicts.  The
+   window doubles, up to FAULT_AROUND_MAX pages, while each fault lands
+   right where the previous window ended, and drops back to
+   FAULT_AROUND_MIN on any other fault.  In a range advised
+   MADV_SEQUENTIAL it is FAULT_AROUND_SEQUENTIAL pages throughout.
+   Caller holds FAULTED's lock.  FAULTED's frame may already be unpinned
+   and an evictor holding T's table lock may be waiting for that lock,
+   so the table lock is only tried; the window ends when it is busy. */
+static void
+fault_around (struct thread *t, struct sup_page_entry *faulted, int advice)
+{
+  struct sup_page_entry *entries[FAULT_AROUND_SEQUENTIAL];
+  void *kpages[FAULT_AROUND_SEQUENTIAL];
+  const void *upage = faulted->upage;
+
+  if (advice == MADV_SEQUENTIAL)
+    t->ra_window = FAULT_AROUND_SEQUENTIAL;
+  else if (upage == t->ra_next)
+    t->ra_window = t->ra_window * 2 > FAULT_AROUND_MAX ? FAULT_AROUND_MAX
+                                                       : t->ra_window * 2;
+  else
+    t->ra_window = FAULT_AROUND_MIN;
+
+  int mapped = 0;   // pages mapped so far, read or shared
+  int cnt = 0;      // of those, pages that still need reading
+  while (mapped < t->ra_window) {
+    const void *next = (const char *) upage + (mapped + 1) * PGSIZE;
+    if (!is_user_vaddr (next))
+      break;
+
+    if (!lock_try_acquire (&t->sup_page_table_lock))
+      break;
+    struct sup_page_entry *entry = get_or_create_entry (t, next);
+    if (entry == NULL || entry->file != faulted->file || zero_fill (entry) ||
+        !lock_try_acquire (&entry->lock)) {
+      lock_release (&t->sup_page_table_lock);
+      break;
+    }
+    lock_release (&t->sup_page_table_lock);
+
+    if (entry->page_loc == UNMAPPED && share_candidate (entry) &&
+        share_join (entry, false) != NULL) {
+      lock_release (&entry->lock);
+      mapped++;
+      continue;
+    }
+
+    void *kpage = NULL;
+    if (entry->page_loc == UNMAPPED)
+      kpage = frame_add_if_free (entry, true);
+    if (kpage == NULL) {
+      lock_release (&entry->lock);
+      break;
+    }
+
+    entries[cnt] = entry;
+    kpages[cnt] = kpage;
+    cnt++;
+    mapped++;
+  }
+
+  /* Next sequential fault is expected just past what we mapped. */
+  t->ra_next = (const char *) upage + (mapped + 1) * PGSIZE;
+  if (cnt == 0)
+    return;
+
+  int i;
+  for (i = 0; i < cnt; i++)
+    read_file_page (entries[i], kpages[i]);
+
+  for (i = 0; i < cnt; i++) {
+    entries[i]->kpage = kpages[i];
+    entries[i]->page_loc = MAIN_MEMORY;
+    if (share_candidate (entries[i]))
+      share_register (entries[i], kpages[i], false);
+    else
+      frame_unpin (entries[i]->upage);
+    lock_release (&entries[i]->lock);
+  }
+}
+
+/* Fills KPAGE with ENTRY's contents, from its file or swap slot or
+   zeroes.  Returns true if that took I/O. */
+static bool
+load_page (struct sup_page_entry *entry, void *kpage)
+{
+  if (entry->page_loc == SWAP_DISK) {
+    swap_read_page (entry->swap_index, kpage);
+    entry->swap_index = -1;
+    entry->thread->vm_stats.swap_ins++;
+    return true;
+  }
+
+  if (entry->zeroed)
+    memset (kpage, 0, PGSIZE);
+  if (entry->page_type != _FILE && entry->page_type != _EXEC)
+    return false;
+
+  read_file_page (entry, kpage);
+  return true;
+}
+
+/* Makes T's pages in the window before the most recent one look
+   unreferenced, so that in a MADV_SEQUENTIAL range the evictor takes
+   what has been read past before anything still in use.  UPAGE has
+   just been faulted in; START is the start of its range. */
+static void
+deactivate_behind (struct thread *t, const void *upage, const void *start)
+{
+  const size_t window = FAULT_AROUND_SEQUENTIAL * PGSIZE;
+  if ((size_t) ((const char *) upage - (const char *) start) <= window)
+    return;
+
+  const char *first = (const char *) upage - 2 * window;
+  if (first < (const char *) start)
+    first = start;
+  const char *p;
+  for (p = first; p < (const char *) upage - window; p += PGSIZE)
+    frame_deactivate (t, p);
+}
+
+/* Called after the current process has faulted UPAGE in by growing its
+   stack: grows the stack further and maps zeroed frames below UPAGE,
+   so a function with a large stack frame, or a deep recursion, doesn't
+   take one fault per page.  The run doubles, up to STACK_GROW_MAX
+   pages, while each fault lands right below the previous run, and
+   drops back to STACK_GROW_MIN on any other.  Stops where the stack
+   can't grow, an entry is busy or no frame is free; never evicts. */
+void
+page_pregrow_stack (const void *upage)
+{
+  struct thread *t = thread_current ();
+  upage = pg_round_down (upage);
+
+  if (upage == t->stack_next && t->stack_window * 2 <= STACK_GROW_MAX)
+    t->stack_window *= 2;
+  else if (upage != t->stack_next)
+    t->stack_window = STACK_GROW_MIN;
+
+  const char *p = upage;
+  int cnt;
+  for (cnt = 0; cnt < t->stack_window; cnt++) {
+    const char *next = p - PGSIZE;
+    lock_acquire (&t->sup_page_table_lock);
+    struct sup_page_entry *entry = NULL;
+    if (vma_grow_stack (t, next))
+      entry = get_or_create_entry (t, next);
+    if (entry == NULL || !lock_try_acquire (&entry->lock)) {
+      lock_release (&t->sup_page_table_lock);
+      break;
+    }
+    lock_release (&t->sup_page_table_lock);
+
+    void *kpage = NULL;
+    if (entry->page_loc == UNMAPPED)
+      kpage = frame_add_if_free (entry, false);
+    if (kpage != NULL) {
+      load_page (entry, kpage);  // zeroes it
+      entry->kpage = kpage;
+      entry->page_loc = MAIN_MEMORY;
+    }
+    lock_release (&entry->lock);
+    if (kpage == NULL)
+      break;
+    p = next;
+  }
+
+  /* Next growth fault is expected just below what we mapped. */
+  t->stack_next = p - PGSIZE;
+}
+
+/* Returns true if UPAGE, in VMA, should come out of a large page
+   reservation: VMA spans the whole 4 MB aligned region around it. */
+static bool
+large_page_candidate (const struct vma *vma, const void *upage)
+{
+  uintptr_t start = (uintptr_t) upage & ~(uintptr_t) (PTSPAN - 1);
+  return (frame_large_pages && (uintptr_t) vma->start <= start &&
+          start + PTSPAN <= (uintptr_t) vma->end);
+}
+
 /* map an address into main memory, evicting another frame if necessary */
 void *
 page_map (const void *upage, bool pinned)
 {
   struct thread *t = thread_current ();
-  lock_acquire (&t->sup_page_table_lock);
-
+  struct sup_page_entry *entry;
+  int advice;
+  const void *range_start;
+  bool large;
   upage = pg_round_down (upage); 
-  struct sup_page_entry *entry = get_sup_page_entry (t, upage);  
-  lock_acquire (&entry->lock);
-  lock_release (&t->sup_page_table_lock);
 
-  ASSERT (entry->page_loc != MAIN_MEMORY);
+  while (true) {
+    lock_acquire (&t->sup_page_table_lock);
+    entry = get_or_create_entry (t, upage);  
+    struct vma *vma = vma_find (t, upage);
+    advice = vma->advice;
+    range_start = vma->start;
+    large = large_page_candidate (vma, upage);
+    lock_acquire (&entry->lock);
+    lock_release (&t->sup_page_table_lock);
 
+    if (entry->page_loc != MAIN_MEMORY)
+      break;
+
+    /* Paged in by madvise(MADV_WILLNEED) while we waited for the lock,
+       or being evicted after a failed pin; in that case let the
+       evictor finish and try again. */
+    if (!pinned || frame_try_pin (upage)) {
+      t->vm_stats.minor_faults++;
+      lock_release (&entry->lock);
+      return entry->kpage;
+    }
+    lock_release (&entry->lock);
+    thread_yield ();
+  }
+
+  if (entry->page_loc == ZERO_PAGE) {  // first write, zero frame goes
+    pagedir_clear_page (t->pagedir, upage);
+    entry->page_loc = UNMAPPED;
+  }
+
+  /* Read-only executable pages are shared between processes running
+     the same binary; map the existing frame if there is one. */
+  bool shareable = entry->page_loc == UNMAPPED && share_candidate (entry);
   void *kpage = NULL;
-  kpage = frame_add (entry, pinned); // takes care of eviction
+  if (shareable) {
+    kpage = share_join (entry, pinned);
+    if (kpage != NULL) {
+      t->vm_stats.minor_faults++;
+      lock_release (&entry->lock);
+      return kpage;
+    }
+  }
+
+  if (large && !shareable)
+    kpage = frame_add_reserved (entry, pinned);
+  if (kpage == NULL)
+    kpage = frame_add (entry, pinned || shareable); // takes care of eviction
   ASSERT (kpage != NULL)
 
-  if (entry->page_loc == UNMAPPED) {
+  bool from_swap = entry->page_loc == SWAP_DISK;
+  bool major = load_page (entry, kpage);
+  if (major)
+    t->vm_stats.major_faults++;
+  else
+    t->vm_stats.minor_faults++;
+  bool read_from_file = major && !from_swap;
+  entry->kpage = kpage;
+  entry->page_loc = MAIN_MEMORY;
+
+  if (shareable)
+    share_register (entry, kpage, pinned);
+  if (read_from_file && advice != MADV_RANDOM)
+    fault_around (t, entry, advice);
+  if (advice == MADV_SEQUENTIAL)
+    deactivate_behind (t, upage, range_start);
 
-    if (entry->zeroed)
-      memset (kpage, 0, PGSIZE);
-    
-    if (entry->page_type == _FILE || entry->page_type == _EXEC) {
-      lock_acquire (&filesys_lock);
-      file_read_at (entry->file, kpage, entry->page_read_bytes,
-                    entry->file_offset);
-      memset ((char *) kpage + entry->page_read_bytes, 0, 
-              PGSIZE - entry->page_read_bytes);
-      lock_release (&filesys_lock);
+  lock_release (&entry->lock);
+
+  return kpage;
+}
+
+/* Reads UPAGE of T in ahead of use for madvise(MADV_WILLNEED), unless
+   it is in memory already, would just be zeroes or its entry is busy.
+   Only takes free frames; never evicts.  Returns false once those run
+   short.  May be called from a thread other than T, with T's exit lock
+   held. */
+bool
+page_prefetch (struct thread *t, const void *upage)
+{
+  lock_acquire (&t->sup_page_table_lock);
+  struct sup_page_entry *entry = get_or_create_entry (t, upage);
+  if (entry == NULL || !lock_try_acquire (&entry->lock)) {
+    lock_release (&t->sup_page_table_lock);
+    return true;
+  }
+  lock_release (&t->sup_page_table_lock);
+
+  bool success = true;
+  if ((entry->page_loc == UNMAPPED && !zero_fill (entry)) ||
+      entry->page_loc == SWAP_DISK) {
+    bool shareable = entry->page_loc == UNMAPPED && share_candidate (entry);
+    if (!shareable || share_join (entry, false) == NULL) {
+      void *kpage = frame_add_if_free (entry, shareable);
+      if (kpage != NULL) {
+        load_page (entry, kpage);
+        entry->kpage = kpage;
+        entry->page_loc = MAIN_MEMORY;
+        if (shareable)
+          share_register (entry, kpage, false);
+      }
+      success = kpage != NULL;
     }
-  
-  } else if (entry->page_loc == SWAP_DISK) {
+  }
 
-    swap_read_page (entry->swap_index, kpage);
-    entry->swap_index = -1;
+  lock_release (&entry->lock);
+  return success;
+}
 
+/* Validates the SIZE bytes at UADDR in the current process's address
+   space for a system call, faults in whatever isn't resident and pins
+   all of it, so the kernel can touch it without faulting.  The range
+   is checked against the address space ranges under one acquisition
+   of the sup page table lock, then resident pages are pinned with
+   frame_pin_range() without looking at the sup page table at all.
+   Returns false, pinning nothing, if part of the range is unmapped or,
+   for WRITE, read-only.  Undo with frame_unpin_range(). */
+bool
+page_pin_range (const void *uaddr, size_t size, bool write)
+{
+  struct thread *t = thread_current ();
+  const void *start = pg_round_down (uaddr);
+  const void *end = pg_round_up ((const char *) uaddr + size);
+
+  lock_acquire (&t->sup_page_table_lock);
+  bool valid = vma_covers (t, start, end);
+  struct vma *vma;
+  for (vma = vma_next (t, start); valid && write && vma != NULL &&
+       vma->start < end; vma = vma_next (t, vma->end))
+    valid = vma->writable;
+  lock_release (&t->sup_page_table_lock);
+  if (!valid)
+    return false;
+
+  const void *upage = start;
+  while ((upage = frame_pin_range (upage, end, write)) < end) {
+    if (pagedir_get_page (t->pagedir, upage) == NULL) {
+      if (write || !page_map_zero (upage))
+        page_map (upage, true);
+    } else if (write && !pagedir_is_writable (t->pagedir, upage)) {
+      page_unshare (upage, true);  // copy-on-write or zero frame
+    } else {
+      page_map (upage, true);  // evicted under us
+    }
+    upage += PGSIZE;
   }
+  return true;
+}
 
-  entry->kpage = kpage;
-  entry->page_loc = MAIN_MEMORY;
+/* Resolves a write fault on UPAGE, which the current process maps
+   copy-on-write after fork() or to the zero frame, by giving it a
+   private writable frame, pinned if PINNED.  Returns the frame. */
+void *
+page_unshare (const void *upage, bool pinned)
+{
+  struct thread *t = thread_current ();
+  lock_acquire (&t->sup_page_table_lock);
+
+  upage = pg_round_down (upage); 
+  struct sup_page_entry *entry = get_sup_page_entry (t, upage);  
+  lock_acquire (&entry->lock);
+  lock_release (&t->sup_page_table_lock);
 
+  void *kpage = share_break (entry, pinned);
+  if (kpage == NULL && entry->page_loc == MAIN_MEMORY) {
+    /* Already private, only the PTE was still read-only, as a 4 MB
+       page always is. */
+    pagedir_set_writable (t->pagedir, upage, true);
+    kpage = entry->kpage;
+    if (pinned && !frame_try_pin (upage))  // being evicted
+      kpage = NULL;
+  }
+
+  if (kpage != NULL)
+    t->vm_stats.minor_faults++;
   lock_release (&entry->lock);
 
+  /* Still on the zero frame, or the shared frame was evicted before we
+     got to it; bring the page in as a private copy instead. */
+  if (kpage == NULL)
+    kpage = page_map (upage, pinned);
   return kpage;
 }
 
+/* Gives CHILD a copy-on-write copy of SRC, its parent's entry for a
+   page in memory or in swap.  Returns false if memory runs out.  Must
+   be locked with share lock, SRC's lock and CHILD's sup page table
+   lock. */
+static bool
+fork_entry (struct thread *child, struct sup_page_entry *src)
+{
+  struct sup_page_entry *entry = malloc (sizeof (struct sup_page_entry));
+  if (entry == NULL)
+    return false;
+
+  *entry = *src;
+  lock_init (&entry->lock);
+  entry->thread = child;
+  entry->share = NULL;
+  entry->kpage = NULL;
+  if (entry->page_type == _EXEC)
+    entry->file = child->my_exec;
+
+  if (src->page_loc == SWAP_DISK) {
+    swap_dup (src->swap_index);
+  } else if (!share_fork (src, entry)) {
+    free (entry);
+    return false;
+  }
+
+  hash_insert (child->sup_page_table, &entry->elem);
+  return true;
+}
+
+/* Copies PARENT's address space into the current thread's, for
+   fork().  Ranges are copied as they are, except memory-mapped files,
+   which are not inherited.  Stack and executable data pages that are
+   in memory or in swap become copy-on-write: a frame is mapped
+   read-only by both processes through an anonymous share, and a swap
+   slot gains a reference.  Every other page is created afresh on
+   first touch.  PARENT must be blocked, and the caller must hold its
+   exit lock so none of its private frames are evicted meanwhile.
+   Returns false if memory runs out. */
+bool
+page_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&parent->sup_page_table_lock);
+  lock_acquire (&t->sup_page_table_lock);
+
+  bool success = vma_copy (parent, t);
+
+  struct hash_iterator i;
+  hash_first (&i, parent->sup_page_table);
+  while (success && hash_next (&i)) {
+    struct sup_page_entry *src = hash_entry (hash_cur (&i),
+                                             struct sup_page_entry, elem);
+    if (src->page_type == _FILE || share_candidate (src))
+      continue;
+
+    /* The share lock keeps a shared frame of PARENT from being
+       evicted while we look at it. */
+    lock_acquire (&src->lock);
+    lock_acquire (&share_lock);
+    if (src->page_loc == SWAP_DISK || src->page_loc == MAIN_MEMORY)
+      success = fork_entry (t, src);
+    lock_release (&share_lock);
+    lock_release (&src->lock);
+  }
+
+  lock_release (&t->sup_page_table_lock);
+  lock_release (&parent->sup_page_table_lock);
+  return success;
+}
+
+/* Maps UPAGE read-only to the shared zero frame if it is a zero-fill
+   page (see zero_fill()), so reading it costs no frame of its own; the
+   first write replaces the mapping with a private frame through
+   page_unshare().  Returns false, mapping nothing, for other pages. */
+bool
+page_map_zero (const void *upage)
+{
+  struct thread *t = thread_current ();
+  lock_acquire (&t->sup_page_table_lock);
+
+  upage = pg_round_down (upage); 
+  struct sup_page_entry *entry = get_or_create_entry (t, upage);  
+  lock_acquire (&entry->lock);
+  lock_release (&t->sup_page_table_lock);
+
+  bool mapped = false;
+  if (zero_fill (entry) && 
+      pagedir_set_page (t->pagedir, upage, frame_zero (), false)) {
+    entry->page_loc = ZERO_PAGE;
+    t->vm_stats.minor_faults++;
+    mapped = true;
+  }
+
+  lock_release (&entry->lock);
+  return mapped;
+}
+
 /* helper function called by unmap wrappers 
    frees specified page from main memory or swap */
 static void 
 unmap (struct thread *t, struct sup_page_entry *entry)
 {
+  if (entry->share != NULL && share_unmap (entry))
+    return;
+
+  if (file_dirty (t, entry)) {
+    write_file_page (entry, entry->kpage);
+  }
+
   pagedir_clear_page (t->pagedir, entry->upage);
 
   if (entry->page_loc == MAIN_MEMORY) {
+    frame_remove (entry->kpage); 
+  } else if (entry->page_loc == SWAP_DISK) {
+    swap_remove (entry->swap_index);
+    entry->swap_index = -1;
+  }
 
-    if (entry->page_type == _FILE && entry->writable && 
-        pagedir_is_dirty (t->pagedir, entry->upage)) {
-
-      lock_acquire (&filesys_lock);
-      file_write_at (entry->file, entry->kpage, PGSIZE, entry->file_offset);
-      lock_release (&filesys_lock);
-    }
+  entry->kpage = NULL;
+  entry->page_loc = UNMAPPED;
+}
 
-    frame_remove (entry->kpage); 
+/* Writes the CNT locked entries of T in RUN, dirty pages that hold
+   consecutive bytes of one file, back with a single write through
+   BUFFER, or page by page if BUFFER is NULL.  Unlocks them. */
+static void
+writeback_run (struct thread *t, struct sup_page_entry **run, int cnt,
+               uint8_t *buffer)
+{
+  size_t size = 0;
+  int i;
+  for (i = 0; i < cnt; i++) {
+    pagedir_set_dirty (t->pagedir, run[i]->upage, false);
+    if (buffer != NULL)
+      memcpy (buffer + size, run[i]->kpage, run[i]->page_read_bytes);
+    size += run[i]->page_read_bytes;
+  }
 
-  } else if (entry->page_loc == SWAP_DISK) { // file being unmapped is on swap
+  if (buffer != NULL && cnt > 0)
+    file_write_at (run[0]->file, buffer, size, run[0]->file_offset);
+  else
+    for (i = 0; i < cnt; i++)
+      write_file_page (run[i], run[i]->kpage);
 
-    if (entry->page_type == _FILE && entry->writable &&
-        pagedir_is_dirty (t->pagedir, entry->upage)) {
+  for (i = 0; i < cnt; i++)
+    lock_release (&run[i]->lock);
+}
 
-      lock_acquire (&filesys_lock);
+/* Writes T's dirty pages of memory-mapped files in [START, END) back,
+   going through each file in offset order and writing only the bytes
+   that belong to it.  Runs of up to WRITEBACK_MAX_RUN pages holding
+   consecutive bytes of a file go out as one write.  The pages stay
+   mapped, now clean.  Must be locked with T's exit lock, which keeps
+   the evictor off the pages, and its sup page table lock. */
+void
+page_writeback (struct thread *t, const void *start, const void *end)
+{
+  struct sup_page_entry *run[WRITEBACK_MAX_RUN];
+  int cnt = 0;
+  uint8_t *buffer = palloc_get_multiple (0, WRITEBACK_MAX_RUN);
 
-      char *buffer = palloc_get_page (0);
-      ASSERT (buffer != NULL);
-      swap_read_page (entry->swap_index, buffer);
-      file_write_at (entry->file, buffer, PGSIZE, entry->file_offset);      
-      palloc_free_page (buffer);
+  struct vma *vma;
+  for (vma = vma_next (t, start); vma != NULL && vma->start < end;
+       vma = vma_next (t, vma->end)) {
+    if (vma->page_type != _FILE || !vma->writable)
+      continue;
 
-      lock_release (&filesys_lock);
+    const void *upage = vma->start > start ? vma->start : start;
+    const void *last = vma->end < end ? vma->end : end;
+    for (; upage < last; upage += PGSIZE) {
+      struct sup_page_entry *entry = get_sup_page_entry (t, upage);
+      if (entry != NULL) {
+        lock_acquire (&entry->lock);
+        if (!file_dirty (t, entry)) {
+          lock_release (&entry->lock);
+          entry = NULL;
+        }
+      }
 
-    } else {
-      swap_remove (entry->swap_index);
+      struct sup_page_entry *prev = cnt > 0 ? run[cnt - 1] : NULL;
+      if (prev != NULL && 
+          (entry == NULL || cnt == WRITEBACK_MAX_RUN ||
+           entry->file != prev->file ||
+           entry->file_offset != prev->file_offset + prev->page_read_bytes)) {
+        writeback_run (t, run, cnt, buffer);
+        cnt = 0;
+      }
+      if (entry != NULL)
+        run[cnt++] = entry;
     }
-
-    entry->swap_index = -1;
   }
+  writeback_run (t, run, cnt, buffer);
 
-  entry->kpage = NULL;
-  entry->page_loc = UNMAPPED;
+  if (buffer != NULL)
+    palloc_free_multiple (buffer, WRITEBACK_MAX_RUN);
+}
+
+/* Writes the current process's dirty pages of memory-mapped files in
+   [START, END) back, like page_writeback(), for msync(). */
+void
+page_msync (const void *start, const void *end)
+{
+  struct thread *t = thread_current ();
+  lock_acquire (&t->exit_lock);
+  lock_acquire (&t->sup_page_table_lock);
+  page_writeback (t, start, end);
+  lock_release (&t->sup_page_table_lock);
+  lock_release (&t->exit_lock);
 }
 
-/* This function is not concurrency safe, it relies on the user to acquire
-  the sup entry lock */
-void 
-page_unmap_via_entry (struct thread *t, struct sup_page_entry *entry)
+/* Unmaps ENTRY of T, writing a dirty file page back, and frees it.
+   Must be locked with T's exit lock and sup page table lock. */
+static void
+drop_entry (struct thread *t, struct sup_page_entry *entry)
 {
+  lock_acquire (&entry->lock);
   unmap (t, entry);
+  lock_release (&entry->lock);
+  hash_delete (t->sup_page_table, &entry->elem);
+  free (entry);
 }
 
-//Assumes that a lock for this is already held, ie., not concurrency safe
-/* unmap a page from physical memory */
-// called in syscall.c
+/* Unmaps the ranges of the current process within [START, END),
+   writing dirty file pages back through page_writeback(), and forgets
+   them.  Holds the exit lock
+   like process_exit(), so the evictor leaves the range alone. */
 void
-page_unmap_via_upage (struct thread *t, void *upage) 
+page_remove_range (const void *start, const void *end)
 {
+  struct thread *t = thread_current ();
+  lock_acquire (&t->exit_lock);
   lock_acquire (&t->sup_page_table_lock);
 
-  upage = pg_round_down (upage); 
-  struct sup_page_entry *entry = get_sup_page_entry (t, upage);  
-  lock_acquire (&entry->lock);
+  page_writeback (t, start, end);
+  const void *upage;
+  for (upage = start; upage < end; upage += PGSIZE) {
+    struct sup_page_entry *entry = get_sup_page_entry (t, upage);
+    if (entry != NULL)  // else never touched
+      drop_entry (t, entry);
+  }
+  vma_remove (t, start, end);
+
   lock_release (&t->sup_page_table_lock);
+  lock_release (&t->exit_lock);
+}
 
-  unmap (t, entry);
+/* Frees a supplemental page table entry. */
+static void
+free_entry (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct sup_page_entry, elem));
+}
 
-  lock_release (&entry->lock);
+/* Frees the frames, swap slots and entries of exiting process T,
+   whose dirty file pages must already have been written back with
+   page_writeback().  Nothing else is written: anonymous and executable
+   pages are simply dropped.  Frames go back to the free lists and swap
+   slots to the swap table PAGE_FREE_BATCH at a time, and page table
+   entries are left for pagedir_destroy().  Locked with T's exit lock
+   and sup page table lock, so the evictor leaves T's private frames
+   alone; shared ones are detached under share lock. */
+void
+page_destroy (struct thread *t)
+{
+  void *kpages[PAGE_FREE_BATCH];
+  int slots[PAGE_FREE_BATCH];
+  size_t kpage_cnt = 0, slot_cnt = 0;
+  struct hash_iterator i;
+
+  hash_first (&i, t->sup_page_table);
+  bool more = hash_next (&i) != NULL;
+  while (more) {
+    lock_acquire (&share_lock);
+    for (; more && kpage_cnt < PAGE_FREE_BATCH && slot_cnt < PAGE_FREE_BATCH;
+         more = hash_next (&i) != NULL) {
+      struct sup_page_entry *entry = hash_entry (hash_cur (&i),
+                                                 struct sup_page_entry, elem);
+      if (share_detach (entry))
+        continue;
+      if (entry->page_loc == MAIN_MEMORY)
+        kpages[kpage_cnt++] = entry->kpage;
+      else if (entry->page_loc == SWAP_DISK)
+        slots[slot_cnt++] = entry->swap_index;
+    }
+    lock_release (&share_lock);
+
+    frame_remove_multiple (kpages, kpage_cnt);
+    swap_remove_multiple (slots, slot_cnt);
+    kpage_cnt = slot_cnt = 0;
+  }
+
+  hash_destroy (t->sup_page_table, free_entry);
+}
+
+/* Returns true if ENTRY can be discarded for MADV_DONTNEED, that is,
+   if it would come back zeroed or as its file has it, unchanged: a
+   stack page, or a file or executable page with no changes of its
+   own.  A written executable data page would come back as the
+   executable has it, neither zeroed nor as written, so it is kept,
+   like a file page with changes not yet written back.  Locked with
+   ENTRY's lock. */
+static bool
+discardable (struct thread *t, struct sup_page_entry *entry)
+{
+  if (entry->page_type == _EXEC)
+    return !entry->written &&
+           !(entry->page_loc == MAIN_MEMORY &&
+             pagedir_is_dirty (t->pagedir, entry->upage));
+  return !file_dirty (t, entry);
 }
 
+/* Applies madvise() ADVICE to the pages of the current process in
+   [START, END), which must all lie in its ranges.  The access pattern
+   hints are recorded on the ranges; MADV_WILLNEED queues the pages for
+   the page-in thread; MADV_DONTNEED frees the frames and swap slots of
+   the pages discardable() allows right away, so stack pages come back
+   zeroed and clean file and executable pages are read again.  Returns
+   false if the range isn't mapped or memory runs out. */
 bool
-page_entry_present (struct thread *t, const void *upage)
+page_advise (const void *start, const void *end, int advice)
 {
+  struct thread *t = thread_current ();
+  lock_acquire (&t->exit_lock);
   lock_acquire (&t->sup_page_table_lock);
 
-  upage = pg_round_down (upage); 
-  struct sup_page_entry *entry = get_sup_page_entry (t, upage);  
+  bool success = vma_covers (t, start, end);
+  if (success && advice == MADV_DONTNEED) {
+    const void *upage;
+    for (upage = start; upage < end; upage += PGSIZE) {
+      struct sup_page_entry *entry = get_sup_page_entry (t, upage);
+      if (entry == NULL)
+        continue;
+      lock_acquire (&entry->lock);
+      bool discard = discardable (t, entry);
+      lock_release (&entry->lock);
+      if (discard)
+        drop_entry (t, entry);
+    }
+  } else if (success && advice != MADV_WILLNEED) {
+    success = vma_set_advice (t, start, end, advice);
+  }
+
   lock_release (&t->sup_page_table_lock);
+  lock_release (&t->exit_lock);
 
-  if (entry == NULL) return false;
-  return true;
+  /* Not under the exit lock: the page-in thread takes it. */
+  if (success && advice == MADV_WILLNEED)
+    pagein_request (t, start, end);
+  return success;
+}
+
+bool
+page_entry_present (struct thread *t, const void *upage)
+{
+  lock_acquire (&t->sup_page_table_lock);
+  bool present = vma_find (t, pg_round_down (upage)) != NULL;
+  lock_release (&t->sup_page_table_lock);
+  return present;
 }
 
 bool 
 page_writable (struct thread *t, const void *upage) 
 {
   lock_acquire (&t->sup_page_table_lock);
-
-  upage = pg_round_down (upage); 
-  struct sup_page_entry *entry = get_sup_page_entry (t, upage);  
-  lock_acquire (&entry->lock);
+  struct vma *vma = vma_find (t, pg_round_down (upage));
+  bool page_writable = vma != NULL && vma->writable;
   lock_release (&t->sup_page_table_lock);
-
-  bool page_writable = false;
-  if (entry != NULL) 
-     page_writable = entry->writable;
-
-  lock_release (&entry->lock); 
   return page_writable;
 }
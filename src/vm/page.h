@@ -2,13 +2,16 @@
 #define VM_PAGE_H 
 
 #include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
 
 #define STACK_SIZE_LIMIT 1073741824 // one gigabyte
 
 enum page_loc {
   UNMAPPED = 0,     // unmapped to physical memory
   MAIN_MEMORY = 1,
-  SWAP_DISK = 2
+  SWAP_DISK = 2,
+  ZERO_PAGE = 3     // mapped read-only to the shared zero frame
 };
 
 enum page_type {
@@ -17,6 +20,18 @@ enum page_type {
   _FILE = 2
 };
 
+/* Usage hints given with madvise(), kept per range.  The values match
+   the MADV_* constants of lib/user/syscall.h. */
+enum page_advice {
+  MADV_NORMAL = 0,      // no hint, adaptive fault-around
+  MADV_SEQUENTIAL = 1,  // read ahead widely, reclaim pages read past
+  MADV_RANDOM = 2,      // no fault-around
+  MADV_WILLNEED = 3,    // page in ahead of use, in the background
+  MADV_DONTNEED = 4     // discard now, refilled on next touch
+};
+
+/* State of one page of a range (see vm/vma.h), created when the page
+   is first touched. */
 struct sup_page_entry {
   const void *upage;            //  user virtual address
   struct hash_elem elem;
@@ -36,25 +51,56 @@ struct sup_page_entry {
   bool writable;
   bool written;
   struct lock lock;
+
+  struct thread *thread;          // owner, to reach its pagedir
+  struct page_share *share;       // shared frame mapped, if any
+  struct list_elem share_elem;    // element in the share's mapper list
 };
 
 /* Initializing the supp page table */
 struct hash *page_init (void);
 
-/* Adding and removing entries in the supplemental page table */
-void page_add_entry (struct hash *sup_page_table, const void *upage, 
-                     void *kpage, int page_type, int page_loc, int swap_index, 
-                     int page_read_bytes, struct file *file, 
-                     int file_offset, bool zeroed, bool writable);
-void page_remove_entry (void *upage);
+/* Adding and removing ranges of the address space; entries in the
+   supplemental page table are created from them when pages are
+   touched */
+bool page_add_range (const void *start, size_t page_cnt, int page_type,
+                     struct file *file, off_t offset, size_t read_bytes,
+                     bool writable);
+bool page_grow_stack (const void *upage);
+void page_pregrow_stack (const void *upage);
+bool page_range_free (const void *start, const void *end);
+void page_remove_range (const void *start, const void *end);
+bool page_advise (const void *start, const void *end, int advice);
+void page_msync (const void *start, const void *end);
+void page_writeback (struct thread *t, const void *start, const void *end);
+void page_destroy (struct thread *t);
+
+/* If true, processes print their struct vm_stats when they exit. */
+extern bool page_stats_on_exit;
+
+#define FAULT_AROUND_MIN 1     // pages mapped after a non-sequential fault
+#define FAULT_AROUND_MAX 16    // per-process cap on the fault-around window
+#define FAULT_AROUND_SEQUENTIAL 32  // fixed window in MADV_SEQUENTIAL ranges
+#define PAGE_EVICT_CLUSTER 8   // most pages page_evict_multiple() takes
+#define WRITEBACK_MAX_RUN 16   // most pages page_writeback() merges
+#define PAGE_FREE_BATCH 64     // frames or slots page_destroy() frees at once
+#define STACK_GROW_MIN 1       // pages mapped ahead after a stack fault
+#define STACK_GROW_MAX 32      // cap on the stack pre-growth run
 
 void page_evict (struct thread *t, const void *upage);
+void page_evict_multiple (struct thread **threads, const void **upages,
+                          int cnt, bool *evicted);
 
 /*Mapping or unmapping a uaddr, this must already have a valid entry in the
   supp page table */
 void *page_map (const void *upage, bool pinned);
-void page_unmap_via_entry (struct thread *t, struct sup_page_entry *entry);
-void page_unmap_via_upage (struct thread *t, void *upage);
+bool page_map_zero (const void *upage);
+bool page_prefetch (struct thread *t, const void *upage);
+bool page_pin_range (const void *uaddr, size_t size, bool write);
+
+/* Copy-on-write between processes created by fork() */
+bool page_fork (struct thread *parent);
+void *page_unshare (const void *upage, bool pinned);
 
 /* Checking the status of pages */
 bool page_entry_present (struct thread *t, const void *upage);
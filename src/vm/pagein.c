@@ -0,0 +1,98 @@
+#include "vm/pagein.h"
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Page-in thread.  madvise(MADV_WILLNEED) queues a range here and
+   returns at once; this thread then reads the range's pages in with
+   page_prefetch() while the process goes on running.
+
+   The thread holds the owner's exit lock while it works on a request,
+   and takes it before letting go of pagein_lock, so a process that
+   has cancelled its requests in process_exit() only has to wait for
+   its exit lock to know we are done with it. */
+
+struct pagein_request {
+  struct thread *thread;      // owner of the range
+  const void *start;          // first page
+  const void *end;            // one past the last page
+  struct list_elem elem;      // element in pagein_queue
+};
+
+static struct list pagein_queue;
+static struct lock pagein_lock;       // protects pagein_queue
+static struct condition pagein_cond;  // signalled when a request arrives
+
+static void
+pagein_thread (void *aux UNUSED)
+{
+  lock_acquire (&pagein_lock);
+  while (true) {
+    while (list_empty (&pagein_queue))
+      cond_wait (&pagein_cond, &pagein_lock);
+
+    struct pagein_request *r = list_entry (list_pop_front (&pagein_queue),
+                                           struct pagein_request, elem);
+    struct thread *t = r->thread;
+    lock_acquire (&t->exit_lock);
+    lock_release (&pagein_lock);
+
+    const void *upage;
+    for (upage = r->start; upage < r->end; upage += PGSIZE)
+      if (!page_prefetch (t, upage))
+        break;    // out of free frames, don't push others out
+
+    lock_release (&t->exit_lock);
+    free (r);
+    lock_acquire (&pagein_lock);
+  }
+}
+
+/* Starts the page-in thread. */
+void
+pagein_init (void)
+{
+  list_init (&pagein_queue);
+  lock_init (&pagein_lock);
+  cond_init (&pagein_cond);
+  thread_create ("pagein", PRI_DEFAULT, pagein_thread, NULL);
+}
+
+/* Queues the pages of T in [START, END) to be read in.  Silently does
+   nothing if memory is short, since it is only a hint.  The caller
+   must not hold T's exit lock. */
+void
+pagein_request (struct thread *t, const void *start, const void *end)
+{
+  struct pagein_request *r = malloc (sizeof (struct pagein_request));
+  if (r == NULL)
+    return;
+  r->thread = t;
+  r->start = start;
+  r->end = end;
+
+  lock_acquire (&pagein_lock);
+  list_push_back (&pagein_queue, &r->elem);
+  cond_signal (&pagein_cond, &pagein_lock);
+  lock_release (&pagein_lock);
+}
+
+/* Drops T's queued requests.  Called when T exits, before it takes its
+   exit lock to tear down its address space. */
+void
+pagein_cancel (struct thread *t)
+{
+  lock_acquire (&pagein_lock);
+  struct list_elem *e = list_begin (&pagein_queue);
+  while (e != list_end (&pagein_queue)) {
+    struct pagein_request *r = list_entry (e, struct pagein_request, elem);
+    e = list_next (e);
+    if (r->thread == t) {
+      list_remove (&r->elem);
+      free (r);
+    }
+  }
+  lock_release (&pagein_lock);
+}
@@ -0,0 +1,10 @@
+#ifndef VM_PAGEIN_H
+#define VM_PAGEIN_H
+
+#include "threads/thread.h"
+
+void pagein_init (void);
+void pagein_request (struct thread *t, const void *start, const void *end);
+void pagein_cancel (struct thread *t);
+
+#endif
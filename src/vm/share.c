@@ -0,0 +1,378 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+struct lock share_lock;
+static struct hash share_table;   // registry of file-backed shares
+
+static unsigned
+share_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct page_share *share = hash_entry (e, struct page_share, elem);
+  return (hash_int ((int) share->inode) ^ hash_int (share->offset)
+          ^ hash_int (share->read_bytes));
+}
+
+static bool
+share_less_func (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  struct page_share *share_a = hash_entry (a, struct page_share, elem);
+  struct page_share *share_b = hash_entry (b, struct page_share, elem);
+  if (share_a->inode != share_b->inode)
+    return (unsigned) share_a->inode < (unsigned) share_b->inode;
+  if (share_a->offset != share_b->offset)
+    return share_a->offset < share_b->offset;
+  return share_a->read_bytes < share_b->read_bytes;
+}
+
+void
+share_init (void)
+{
+  lock_init (&share_lock);
+  hash_init (&share_table, &share_hash_func, &share_less_func, NULL);
+}
+
+/* Returns true if ENTRY's page may be shared with other processes,
+   that is, it is a read-only page of an executable. */
+bool
+share_candidate (const struct sup_page_entry *entry)
+{
+  return entry->page_type == _EXEC && !entry->writable;
+}
+
+//Must be locked with share lock
+static struct page_share *
+share_lookup (struct inode *inode, off_t offset, int read_bytes)
+{
+  struct page_share dummy;
+  dummy.inode = inode;
+  dummy.offset = offset;
+  dummy.read_bytes = read_bytes;
+  struct hash_elem *e = hash_find (&share_table, &dummy.elem);
+  if (e == NULL)
+    return NULL;
+  return hash_entry (e, struct page_share, elem);
+}
+
+/* Makes ENTRY a mapper of SHARE and maps the frame read-only into its
+   owner's page directory.  Must be locked with share lock. */
+static void
+share_attach (struct page_share *share, struct sup_page_entry *entry)
+{
+  list_push_back (&share->mappers, &entry->share_elem);
+  entry->share = share;
+  entry->kpage = share->kpage;
+  entry->page_loc = MAIN_MEMORY;
+  pagedir_set_page (entry->thread->pagedir, entry->upage, share->kpage, 
+                    false);
+}
+
+/* Maps the frame another process already has for ENTRY's (inode,
+   offset, read bytes), if any, pinning it if PINNED.  Returns the
+   frame or NULL if there is none.  ENTRY's lock must be held, and if
+   PINNED, ENTRY must belong to the current thread. */
+void *
+share_join (struct sup_page_entry *entry, bool pinned)
+{
+  void *kpage = NULL;
+
+  lock_acquire (&share_lock);
+  struct page_share *share = share_lookup (file_get_inode (entry->file),
+                                           entry->file_offset,
+                                           entry->page_read_bytes);
+  if (share != NULL) {
+    share_attach (share, entry);
+    if (pinned)
+      frame_pin (entry->upage);
+    kpage = share->kpage;
+  }
+  lock_release (&share_lock);
+
+  return kpage;
+}
+
+/* Publishes KPAGE, which ENTRY's data has just been read into and
+   mapped through frame_add() pinned, so later processes can share it,
+   and keeps that pin only if PINNED.  If another process
+   registered the same page in the meantime, ENTRY keeps KPAGE as a
+   private copy.  ENTRY's lock must be held, with kpage and page_loc
+   already set. */
+void
+share_register (struct sup_page_entry *entry, void *kpage, bool pinned)
+{
+  lock_acquire (&share_lock);
+
+  struct inode *inode = file_get_inode (entry->file);
+  struct page_share *share = NULL;
+  if (share_lookup (inode, entry->file_offset,
+                    entry->page_read_bytes) == NULL)
+    share = malloc (sizeof (struct page_share));
+
+  if (share != NULL) {
+    share->inode = inode;
+    share->offset = entry->file_offset;
+    share->read_bytes = entry->page_read_bytes;
+    share->kpage = kpage;
+    share->evicting = false;
+    list_init (&share->mappers);
+    hash_insert (&share_table, &share->elem);
+
+    list_push_back (&share->mappers, &entry->share_elem);
+    entry->share = share;
+    frame_set_share (kpage, share);
+  }
+  if (!pinned)
+    frame_unpin_kpage (kpage);
+
+  lock_release (&share_lock);
+}
+
+/* Detaches ENTRY from the shared frame it maps, freeing the frame if
+   ENTRY was its last mapper and it is not being evicted.  Returns
+   false if ENTRY does not map a shared frame.  ENTRY's lock must be
+   held. */
+bool
+share_unmap (struct sup_page_entry *entry)
+{
+  lock_acquire (&share_lock);
+  bool unmapped = share_detach (entry);
+  lock_release (&share_lock);
+  return unmapped;
+}
+
+/* Like share_unmap(), but must be locked with share lock instead of
+   ENTRY's lock, which also keeps the evictor from changing ENTRY if
+   it doesn't map a shared frame. */
+bool
+share_detach (struct sup_page_entry *entry)
+{
+  struct page_share *share = entry->share;
+  if (share == NULL)
+    return false;
+
+  list_remove (&entry->share_elem);
+  entry->share = NULL;
+  entry->kpage = NULL;
+  entry->page_loc = UNMAPPED;
+  pagedir_clear_page (entry->thread->pagedir, entry->upage);
+
+  if (list_empty (&share->mappers) && !share->evicting) {
+    if (share->inode != NULL)
+      hash_delete (&share_table, &share->elem);
+    frame_remove (share->kpage);
+    free (share);
+  }
+  return true;
+}
+
+/* Makes CHILD, fork()'s copy of PARENT, map PARENT's frame
+   copy-on-write.  A private frame becomes an anonymous share that both
+   map read-only; a frame PARENT already shares with earlier children
+   gains CHILD as one more mapper.  Returns false if CHILD's page table
+   cannot grow.  Must be locked with share lock, with PARENT's lock
+   held and its frame kept from eviction by its owner's exit lock. */
+bool
+share_fork (struct sup_page_entry *parent, struct sup_page_entry *child)
+{
+  struct page_share *share = parent->share;
+
+  if (share == NULL) {
+    share = malloc (sizeof (struct page_share));
+    if (share == NULL)
+      return false;
+    share->inode = NULL;
+    share->offset = 0;
+    share->read_bytes = 0;
+    share->kpage = parent->kpage;
+    share->evicting = false;
+    list_init (&share->mappers);
+
+    /* The frame may differ from the executable from now on even if
+       whoever writes next is the other process. */
+    if (pagedir_is_dirty (parent->thread->pagedir, parent->upage))
+      parent->written = true;
+    pagedir_set_writable (parent->thread->pagedir, parent->upage, false);
+    list_push_back (&share->mappers, &parent->share_elem);
+    parent->share = share;
+    frame_set_share (share->kpage, share);
+  }
+
+  if (!pagedir_set_page (child->thread->pagedir, child->upage, share->kpage,
+                         false))
+    return false;
+  list_push_back (&share->mappers, &child->share_elem);
+  child->share = share;
+  child->kpage = share->kpage;
+  child->page_loc = MAIN_MEMORY;
+  child->written = parent->written;
+  return true;
+}
+
+/* Resolves a write to ENTRY's copy-on-write page: ENTRY leaves its
+   anonymous share and gets a private, writable frame, pinned if
+   PINNED, which is returned.  The last mapper takes the shared frame
+   over, unless it is being evicted; anyone else copies it.  Returns
+   NULL if ENTRY no longer maps a share.  ENTRY must belong to the
+   current thread and its lock must be held. */
+void *
+share_break (struct sup_page_entry *entry, bool pinned)
+{
+  uint32_t *pd = entry->thread->pagedir;
+
+  lock_acquire (&share_lock);
+
+  struct page_share *share = entry->share;
+  if (share == NULL) {
+    lock_release (&share_lock);
+    return NULL;
+  }
+  ASSERT (share->inode == NULL);
+
+  list_remove (&entry->share_elem);
+  entry->share = NULL;
+
+  void *kpage = share->kpage;
+  if (list_empty (&share->mappers) && !share->evicting) {
+    frame_set_private (kpage, entry->thread, entry->upage, pinned);
+    pagedir_set_writable (pd, entry->upage, true);
+    free (share);
+    lock_release (&share_lock);
+    return kpage;
+  }
+
+  /* Copy the data out while the share lock keeps the frame from being
+     evicted, or an eviction under way from finishing, and drop it
+     before frame_add() may have to evict. */
+  void *buffer = palloc_get_page (0);
+  ASSERT (buffer != NULL);
+  memcpy (buffer, kpage, PGSIZE);
+  entry->kpage = NULL;
+  entry->page_loc = UNMAPPED;
+  pagedir_clear_page (pd, entry->upage);
+  lock_release (&share_lock);
+
+  kpage = frame_add (entry, pinned);
+  memcpy (kpage, buffer, PGSIZE);
+  palloc_free_page (buffer);
+  entry->kpage = kpage;
+  entry->page_loc = MAIN_MEMORY;
+  return kpage;
+}
+
+/* Returns true if any mapper of SHARE accessed it since the last call,
+   and clears every mapper's accessed bit.  Must be locked with share
+   lock. */
+bool
+share_test_and_clear_accessed (struct page_share *share)
+{
+  bool accessed = false;
+
+  struct list_elem *e;
+  for (e = list_begin (&share->mappers); e != list_end (&share->mappers);
+       e = list_next (e)) {
+    struct sup_page_entry *entry = list_entry (e, struct sup_page_entry,
+                                               share_elem);
+    uint32_t *pd = entry->thread->pagedir;
+    if (pagedir_is_accessed (pd, entry->upage)) {
+      accessed = true;
+      pagedir_set_accessed (pd, entry->upage, false);
+    }
+  }
+
+  return accessed;
+}
+
+/* Points ENTRY, just taken off the mappers of an evicted share, at
+   SWAP_INDEX, or at its file if that is -1, and unmaps the frame.
+   FIRST is true for the mapper that takes over the slot's own
+   reference; the others add one.  Must be locked with share lock and
+   ENTRY's lock. */
+static void
+evict_mapper (struct sup_page_entry *entry, int swap_index, bool first)
+{
+  if (swap_index != -1 && !first)
+    swap_dup (swap_index);
+  if (swap_index != -1 && first)
+    entry->thread->vm_stats.swap_outs++;
+  entry->thread->vm_stats.evicted++;
+
+  /* State first, so a fault right after the PTE goes away sees it. */
+  entry->share = NULL;
+  entry->kpage = NULL;
+  entry->swap_index = swap_index;
+  entry->page_loc = swap_index != -1 ? SWAP_DISK : UNMAPPED;
+  pagedir_clear_page (entry->thread->pagedir, entry->upage);
+}
+
+/* Unmaps SHARE's frame from every process mapping it and dissolves the
+   share; the pages will be read back from their file on the next
+   fault.  An anonymous share holding data the file does not have is
+   written to one swap slot that all of its mappers reference.  Must be
+   called with the frame's entry lock and share lock held, and returns
+   with share lock released.
+
+   The share leaves the registry and is marked evicting first, so that
+   nobody joins it or takes its frame over, and the swap write is done
+   without share lock.  Each mapper is then updated under its own lock.
+   Mappers lock their entry before share lock, so those locks are only
+   tried, and share lock is dropped between passes for whoever holds
+   one to finish. */
+void
+share_evict (struct page_share *share)
+{
+  ASSERT (lock_held_by_current_thread (&share_lock));
+
+  share->evicting = true;
+  bool needs_swap = false;
+  if (share->inode != NULL)
+    hash_delete (&share_table, &share->elem);
+  else {
+    struct sup_page_entry *first = list_entry (list_front (&share->mappers),
+                                               struct sup_page_entry,
+                                               share_elem);
+    needs_swap = first->page_type == _STACK || first->written;
+  }
+  lock_release (&share_lock);
+
+  int swap_index = needs_swap ? swap_write_page (share->kpage) : -1;
+  bool first_mapper = true;
+
+  lock_acquire (&share_lock);
+  while (true) {
+    struct list_elem *e = list_begin (&share->mappers);
+    while (e != list_end (&share->mappers)) {
+      struct sup_page_entry *entry = list_entry (e, struct sup_page_entry,
+                                                 share_elem);
+      bool took_lock = !lock_held_by_current_thread (&entry->lock);
+      if (took_lock && !lock_try_acquire (&entry->lock)) {
+        e = list_next (e);
+        continue;
+      }
+      e = list_remove (e);
+      evict_mapper (entry, swap_index, first_mapper);
+      first_mapper = false;
+      if (took_lock)
+        lock_release (&entry->lock);
+    }
+    if (list_empty (&share->mappers))
+      break;
+    lock_release (&share_lock);
+    thread_yield ();
+    lock_acquire (&share_lock);
+  }
+  lock_release (&share_lock);
+
+  /* Everyone left while the page was being written. */
+  if (swap_index != -1 && first_mapper)
+    swap_remove (swap_index);
+  free (share);
+}
@@ -0,0 +1,48 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+#include "vm/page.h"
+
+/* A frame mapped read-only by several sup page entries at once.
+   Shares of read-only executable pages are registered by (inode,
+   offset, read bytes), so a process running a binary that is already
+   running maps the frame in memory instead of reading its own copy.
+   Read bytes are part of the key because two segments may cover the
+   same file page and zero different tails of it.  Anonymous shares,
+   with a null inode, hold stack and data pages that fork() left
+   copy-on-write between parent and child; they are not in the
+   registry. */
+struct page_share {
+  struct inode *inode;     // backing inode, registry key with the next two
+  off_t offset;
+  int read_bytes;          // bytes read from the file, rest zeroed
+  void *kpage;             // the shared frame
+  struct list mappers;     // sup_page_entry's mapping the frame
+  struct hash_elem elem;   // element in the share registry
+  bool evicting;           // being dissolved by share_evict()
+};
+
+/* Protects the registry, every page_share, and the kpage, page_loc and
+   share members of sup page entries that map a shared frame; the
+   evictor changes those only with the entry's lock held as well.
+   Acquired after sup page entry locks and before frame entry locks;
+   the evictor try-acquires it to pick a victim, and share_evict()
+   takes it again only to try the mappers' locks. */
+extern struct lock share_lock;
+
+void share_init (void);
+bool share_candidate (const struct sup_page_entry *entry);
+void *share_join (struct sup_page_entry *entry, bool pinned);
+void share_register (struct sup_page_entry *entry, void *kpage, bool pinned);
+bool share_unmap (struct sup_page_entry *entry);
+bool share_detach (struct sup_page_entry *entry);
+bool share_fork (struct sup_page_entry *parent, struct sup_page_entry *child);
+void *share_break (struct sup_page_entry *entry, bool pinned);
+bool share_test_and_clear_accessed (struct page_share *share);
+void share_evict (struct page_share *share);
+
+#endif
@@ -1,61 +1,233 @@
 #include "vm/swap.h"
 #include <bitmap.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <debug.h>
 #include "devices/block.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "vm/zswap.h"
 
 struct bitmap *swap_table;
 struct lock swap_table_lock;
 
+/* Swap devices.  Slots are striped across them: slot S is page
+   S / swap_dev_cnt of device S % swap_dev_cnt, so a cluster of slots
+   is spread over all of them, and page-ins and page-outs by different
+   threads mostly land on different disks.  No lock is held around
+   swap I/O and the IDE driver only serialises requests to the same
+   channel, so disks on different channels transfer in parallel.
+   Stripes past the end of a smaller device stay allocated for good. */
+#define SWAP_DEVICES_MAX 4
+
+static struct block *swap_devs[SWAP_DEVICES_MAX];
+static size_t swap_dev_cnt;
+
+/* Next-fit cursor: slot allocation resumes where the last one ended,
+   so pages evicted in a burst land next to each other on disk. */
+static size_t swap_cursor;
+
+/* References to each slot beyond the first.  A page that forked
+   processes share copy-on-write is written to one slot when evicted,
+   and the slot stays allocated until every one of them has read it
+   back or dropped it. */
+static uint16_t *swap_refs;
+
+/* Adds BLOCK to the swap devices.  Must be called before
+   swap_init(). */
+void
+swap_add_device (struct block *block)
+{
+  size_t i;
+
+  for (i = 0; i < swap_dev_cnt; i++)
+    if (swap_devs[i] == block)
+      PANIC ("swap device %s given twice", block_name (block));
+  if (swap_dev_cnt >= SWAP_DEVICES_MAX)
+    PANIC ("more than %d swap devices", SWAP_DEVICES_MAX);
+  swap_devs[swap_dev_cnt++] = block;
+}
+
+/* Returns the number of pages device DEV has room for. */
+static size_t
+device_pages (size_t dev)
+{
+  return block_size (swap_devs[dev]) / SECTORS_PER_PAGE;
+}
+
+/* Returns the device holding slot SWAP_INDEX and stores the slot's
+   first sector on it in *SECTOR. */
+static struct block *
+slot_device (size_t swap_index, block_sector_t *sector)
+{
+  *sector = swap_index / swap_dev_cnt * SECTORS_PER_PAGE;
+  return swap_devs[swap_index % swap_dev_cnt];
+}
+
 void 
 swap_init ()
 {
-  int size_in_pages = block_size (block_get_role (BLOCK_SWAP)) / 
-                                  SECTORS_PER_PAGE;
+  size_t stripes = 0;
+  size_t dev;
+  for (dev = 0; dev < swap_dev_cnt; dev++)
+    if (device_pages (dev) > stripes)
+      stripes = device_pages (dev);
+
+  size_t size_in_pages = stripes * swap_dev_cnt;
   swap_table = bitmap_create (size_in_pages);
   ASSERT (swap_table != NULL);
+  size_t slot;
+  for (slot = 0; slot < size_in_pages; slot++)
+    if (slot / swap_dev_cnt >= device_pages (slot % swap_dev_cnt))
+      bitmap_mark (swap_table, slot);
+  swap_refs = calloc (size_in_pages, sizeof *swap_refs);
+  ASSERT (swap_refs != NULL || size_in_pages == 0);
   lock_init (&swap_table_lock);
+  swap_cursor = 0;
+  zswap_init (size_in_pages);
 }
 
-void
-swap_read_page (int swap_index, void *buffer)
+/* Allocates CNT contiguous swap slots, searching from the cursor and
+   wrapping around once.  Returns the first slot or BITMAP_ERROR. */
+static size_t
+swap_alloc (size_t cnt)
 {
-  struct block *swap_block = block_get_role (BLOCK_SWAP);
-
-  int i;
-  for (i = 0; i < SECTORS_PER_PAGE; i++) {
-    block_read (swap_block, swap_index * SECTORS_PER_PAGE + i,
-                (char *) buffer + i * BLOCK_SECTOR_SIZE);
-  }
-
   lock_acquire (&swap_table_lock);
-  bitmap_set (swap_table, swap_index, false);
+  size_t swap_index = bitmap_scan_and_flip (swap_table, swap_cursor, cnt,
+                                            false);
+  if (swap_index == BITMAP_ERROR && swap_cursor != 0)
+    swap_index = bitmap_scan_and_flip (swap_table, 0, cnt, false);
+  if (swap_index != BITMAP_ERROR) {
+    swap_cursor = swap_index + cnt;
+    if (swap_cursor >= bitmap_size (swap_table))
+      swap_cursor = 0;
+  }
   lock_release (&swap_table_lock);
+  return swap_index;
 }
 
-int
-swap_write_page (void *buffer)
+/* Writes CNT pages to consecutive slots starting at SWAP_INDEX.  Pages
+   the compressed tier takes stay in memory; the rest are written in
+   ascending sector order on each device. */
+static void
+swap_write_run (void **pages, size_t cnt, size_t swap_index)
+{
+  size_t i;
+  int j;
+  for (i = 0; i < cnt; i++) {
+    if (zswap_store (swap_index + i, pages[i]))
+      continue;
+    block_sector_t sector;
+    struct block *swap_block = slot_device (swap_index + i, &sector);
+    for (j = 0; j < SECTORS_PER_PAGE; j++) {
+      block_write (swap_block, sector + j, 
+                   (char *) pages[i] + j * BLOCK_SECTOR_SIZE);
+    }
+  }
+}
+
+/* Drops a reference to SWAP_INDEX, freeing the slot with the last. */
+static void
+swap_put (int swap_index)
 {
-  struct block *swap_block = block_get_role (BLOCK_SWAP);
-  
   lock_acquire (&swap_table_lock);
-  int swap_index = bitmap_scan_and_flip (swap_table, 0, 1, false);
+  if (swap_refs[swap_index] > 0) {
+    swap_refs[swap_index]--;
+  } else {
+    bitmap_set (swap_table, swap_index, false);
+    zswap_drop (swap_index);
+  }
   lock_release (&swap_table_lock);
-  ASSERT ((unsigned) swap_index != BITMAP_ERROR);
+}
 
+void
+swap_read_page (int swap_index, void *buffer)
+{
   int i;
-  for (i = 0; i < SECTORS_PER_PAGE; i++) {
-    block_write (swap_block, swap_index * SECTORS_PER_PAGE + i,
-                 (char *) buffer + i * BLOCK_SECTOR_SIZE);
+  if (!zswap_load (swap_index, buffer)) {
+    block_sector_t sector;
+    struct block *swap_block = slot_device (swap_index, &sector);
+    for (i = 0; i < SECTORS_PER_PAGE; i++) {
+      block_read (swap_block, sector + i,
+                  (char *) buffer + i * BLOCK_SECTOR_SIZE);
+    }
   }
 
+  swap_put (swap_index);
+}
+
+int
+swap_write_page (void *buffer)
+{
+  size_t swap_index = swap_alloc (1);
+  ASSERT (swap_index != BITMAP_ERROR);
+
+  swap_write_run (&buffer, 1, swap_index);
   return swap_index;
 }
 
+/* Writes the CNT pages in PAGES to swap and stores the slot of PAGES[i]
+   in SWAP_INDICES[i].  The pages go to one contiguous cluster of slots
+   if the swap table has a free run that long; otherwise the batch is
+   split in halves until every piece fits. */
+void
+swap_write_pages (void **pages, size_t cnt, int *swap_indices)
+{
+  size_t done = 0;
+  while (done < cnt) {
+    size_t run = cnt - done;
+    size_t swap_index;
+    while ((swap_index = swap_alloc (run)) == BITMAP_ERROR) {
+      ASSERT (run > 1);
+      run /= 2;
+    }
+
+    swap_write_run (pages + done, run, swap_index);
+
+    size_t i;
+    for (i = 0; i < run; i++)
+      swap_indices[done + i] = swap_index + i;
+    done += run;
+  }
+}
+
 void 
 swap_remove (int swap_index)
+{
+  swap_put (swap_index);
+}
+
+/* Drops a reference to each of the CNT slots in SLOTS, like
+   swap_remove(), taking the swap table lock once.  Reorders SLOTS. */
+void
+swap_remove_multiple (int *slots, size_t cnt)
+{
+  if (cnt == 0)
+    return;
+
+  size_t freed = 0;
+  size_t i;
+  lock_acquire (&swap_table_lock);
+  for (i = 0; i < cnt; i++) {
+    if (swap_refs[slots[i]] > 0) {
+      swap_refs[slots[i]]--;
+    } else {
+      bitmap_reset (swap_table, slots[i]);
+      slots[freed++] = slots[i];
+    }
+  }
+  zswap_drop_multiple (slots, freed);
+  lock_release (&swap_table_lock);
+}
+
+/* Adds a reference to the allocated slot SWAP_INDEX, so it survives
+   one more swap_read_page() or swap_remove(). */
+void
+swap_dup (int swap_index)
 {
   lock_acquire (&swap_table_lock);
-  bitmap_set (swap_table, swap_index, false);
+  ASSERT (bitmap_test (swap_table, swap_index));
+  ASSERT (swap_refs[swap_index] < UINT16_MAX);
+  swap_refs[swap_index]++;
   lock_release (&swap_table_lock);
 }
@@ -1,13 +1,18 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include <stddef.h>
 #include "devices/block.h"
 
 #define SECTORS_PER_PAGE 8
 
+void swap_add_device (struct block *block);
 void swap_init (void);
 void swap_read_page (int swap_index, void *buffer); // read from swap
 int swap_write_page (void *buffer);                 // write to swap
+void swap_write_pages (void **pages, size_t cnt, int *swap_indices);
 void swap_remove (int swap_index);
+void swap_remove_multiple (int *slots, size_t cnt);
+void swap_dup (int swap_index);                    // share a slot
 
 #endif
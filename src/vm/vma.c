@@ -0,0 +1,232 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* A thread's ranges are kept in T->vmas sorted by address.  Processes
+   have a handful of them, so a linear search beats the per-page hash
+   lookups this replaces. */
+
+/* Returns true if [START, END) intersects an existing range of T. */
+bool
+vma_overlaps (struct thread *t, const void *start, const void *end)
+{
+  struct list_elem *e;
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas);
+       e = list_next (e)) {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    if (start < vma->end && vma->start < end)
+      return true;
+  }
+  return false;
+}
+
+/* Returns true if every page of [START, END) lies in a range of T. */
+bool
+vma_covers (struct thread *t, const void *start, const void *end)
+{
+  while (start < end) {
+    struct vma *vma = vma_find (t, start);
+    if (vma == NULL)
+      return false;
+    start = vma->end;
+  }
+  return true;
+}
+
+/* Adds a range of PAGE_CNT pages at START to T, backed by READ_BYTES
+   bytes of FILE from OFFSET and zeroes after that.  Returns the new
+   range, or NULL if it would overlap another one or memory is short. */
+struct vma *
+vma_add (struct thread *t, const void *start, size_t page_cnt, 
+         int page_type, struct file *file, off_t offset, size_t read_bytes,
+         bool writable)
+{
+  ASSERT (pg_ofs (start) == 0);
+
+  const void *end = (const char *) start + page_cnt * PGSIZE;
+  if (page_cnt == 0 || end > PHYS_BASE || end < start ||
+      vma_overlaps (t, start, end))
+    return NULL;
+
+  struct vma *vma = malloc (sizeof (struct vma));
+  if (vma == NULL)
+    return NULL;
+  vma->start = start;
+  vma->end = end;
+  vma->page_type = page_type;
+  vma->file = file;
+  vma->offset = offset;
+  vma->read_bytes = read_bytes;
+  vma->writable = writable;
+  vma->advice = MADV_NORMAL;
+
+  struct list_elem *e;
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas);
+       e = list_next (e))
+    if (list_entry (e, struct vma, elem)->start > start)
+      break;
+  list_insert (e, &vma->elem);
+  return vma;
+}
+
+/* Returns T's range containing UPAGE, or NULL if there is none. */
+struct vma *
+vma_find (struct thread *t, const void *upage)
+{
+  struct list_elem *e;
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas);
+       e = list_next (e)) {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    if (upage < vma->start)
+      break;
+    if (upage < vma->end)
+      return vma;
+  }
+  return NULL;
+}
+
+/* Splits VMA in two at page AT, if AT lies inside it, so that hints
+   can be set on part of a range.  Returns false if memory runs out. */
+static bool
+vma_split (struct vma *vma, const void *at)
+{
+  if (at <= vma->start || at >= vma->end)
+    return true;
+
+  struct vma *upper = malloc (sizeof (struct vma));
+  if (upper == NULL)
+    return false;
+
+  size_t ofs = (const char *) at - (const char *) vma->start;
+  *upper = *vma;
+  upper->start = at;
+  upper->offset += ofs;
+  upper->read_bytes = vma->read_bytes > ofs ? vma->read_bytes - ofs : 0;
+  vma->end = at;
+  if (vma->read_bytes > ofs)
+    vma->read_bytes = ofs;
+  list_insert (list_next (&vma->elem), &upper->elem);
+  return true;
+}
+
+/* Records ADVICE for the pages of [START, END), which T's ranges must
+   cover, splitting ranges at the ends as needed.  Returns false if
+   memory runs out. */
+bool
+vma_set_advice (struct thread *t, const void *start, const void *end,
+                int advice)
+{
+  while (start < end) {
+    struct vma *vma = vma_find (t, start);
+    ASSERT (vma != NULL);
+    if (!vma_split (vma, start))
+      return false;
+    vma = vma_find (t, start);
+    if (!vma_split (vma, end))
+      return false;
+    vma->advice = advice;
+    start = vma->end;
+  }
+  return true;
+}
+
+/* Returns T's first range that ends after ADDR, or NULL. */
+struct vma *
+vma_next (struct thread *t, const void *addr)
+{
+  struct list_elem *e;
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas);
+       e = list_next (e)) {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    if (addr < vma->end)
+      return vma;
+  }
+  return NULL;
+}
+
+/* Extends T's stack range down to cover UPAGE.  Returns false if that
+   would take the stack past STACK_SIZE_LIMIT or into another range. */
+bool
+vma_grow_stack (struct thread *t, const void *upage)
+{
+  upage = pg_round_down (upage);
+  if (upage < PHYS_BASE - STACK_SIZE_LIMIT)
+    return false;
+
+  if (list_empty (&t->vmas))
+    return false;
+  struct vma *stack = list_entry (list_back (&t->vmas), struct vma, elem);
+  if (stack->page_type != _STACK)
+    return false;
+
+  /* madvise() may have split the stack; grow its lowest piece. */
+  struct vma *below = NULL;
+  while (list_prev (&stack->elem) != list_head (&t->vmas)) {
+    below = list_entry (list_prev (&stack->elem), struct vma, elem);
+    if (below->page_type != _STACK || below->end != stack->start)
+      break;
+    stack = below;
+    below = NULL;
+  }
+  if (upage >= stack->start)
+    return true;
+  if (below != NULL && upage < below->end)
+    return false;
+  stack->start = upage;
+  return true;
+}
+
+/* Gives CHILD, a forked copy of PARENT, PARENT's executable segments
+   and stack.  Memory-mapped files are not inherited.  Returns false if
+   memory runs out.  Both sup page table locks must be held. */
+bool
+vma_copy (struct thread *parent, struct thread *child)
+{
+  struct list_elem *e;
+  for (e = list_begin (&parent->vmas); e != list_end (&parent->vmas);
+       e = list_next (e)) {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    if (vma->page_type == _FILE)
+      continue;
+
+    struct file *file = vma->page_type == _EXEC ? child->my_exec : NULL;
+    size_t page_cnt = ((const char *) vma->end - (const char *) vma->start)
+                      / PGSIZE;
+    struct vma *copy = vma_add (child, vma->start, page_cnt, vma->page_type,
+                                file, vma->offset, vma->read_bytes,
+                                vma->writable);
+    if (copy == NULL)
+      return false;
+    copy->advice = vma->advice;
+  }
+  return true;
+}
+
+/* Removes and frees T's ranges within [START, END), which must not
+   cut through any range.  Their pages must be unmapped. */
+void
+vma_remove (struct thread *t, const void *start, const void *end)
+{
+  struct list_elem *e = list_begin (&t->vmas);
+  while (e != list_end (&t->vmas)) {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    e = list_next (e);
+    if (vma->end <= start || vma->start >= end)
+      continue;
+    ASSERT (vma->start >= start && vma->end <= end);
+    list_remove (&vma->elem);
+    free (vma);
+  }
+}
+
+/* Frees all of T's ranges. */
+void
+vma_destroy (struct thread *t)
+{
+  while (!list_empty (&t->vmas)) {
+    struct list_elem *e = list_pop_front (&t->vmas);
+    free (list_entry (e, struct vma, elem));
+  }
+}
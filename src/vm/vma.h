@@ -0,0 +1,41 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/thread.h"
+
+/* A range of a process's user address space: an executable segment,
+   a memory-mapped file or the stack.  Sup page entries for its pages
+   are only created once a page is first faulted in, from the range's
+   description. */
+struct vma {
+  const void *start;       // first page
+  const void *end;         // one past the last page
+  int page_type;           // _STACK, _EXEC or _FILE
+  struct file *file;       // backing file, if any
+  off_t offset;            // file offset of START
+  size_t read_bytes;       // bytes of file data from START, rest is zeroes
+  bool writable;
+  int advice;              // MADV_* hint from madvise()
+  struct list_elem elem;   // element in the owner's vmas list
+};
+
+/* All of these must be locked with the owner's sup page table lock. */
+struct vma *vma_add (struct thread *t, const void *start, size_t page_cnt,
+                     int page_type, struct file *file, off_t offset,
+                     size_t read_bytes, bool writable);
+struct vma *vma_find (struct thread *t, const void *upage);
+struct vma *vma_next (struct thread *t, const void *addr);
+bool vma_overlaps (struct thread *t, const void *start, const void *end);
+bool vma_covers (struct thread *t, const void *start, const void *end);
+bool vma_set_advice (struct thread *t, const void *start, const void *end,
+                     int advice);
+bool vma_grow_stack (struct thread *t, const void *upage);
+bool vma_copy (struct thread *parent, struct thread *child);
+void vma_remove (struct thread *t, const void *start, const void *end);
+void vma_destroy (struct thread *t);
+
+#endif
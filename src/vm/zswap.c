@@ -0,0 +1,350 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed swap tier.  Pages written to swap are compressed into a
+   slice of kernel pool pages reserved at boot and only go to the swap
+   partition when they don't compress well or the slice is full.  Every
+   page still owns its swap slot, which serves as the key here, so a
+   page can always spill to disk without renumbering. */
+
+#define ZSWAP_DEFAULT_PAGES 32      // reserved kernel pages by default
+#define ZSWAP_CHUNK 64              // allocation unit in the reserve
+#define ZSWAP_MAX_SIZE (PGSIZE / 4 * 3) // store only if it shrinks to this
+
+size_t zswap_pages = ZSWAP_DEFAULT_PAGES;
+
+/* Where a swap slot's compressed copy is; SIZE 0 means it has none. */
+struct zswap_slot {
+  uint16_t chunk;           // first chunk in the reserve
+  uint16_t size;            // compressed bytes
+};
+
+static struct lock zswap_lock;       // protects everything below
+static uint8_t *zswap_area;          // the reserve, zswap_pages pages
+static struct bitmap *zswap_used;    // chunks in use
+static struct zswap_slot *zswap_slots;  // indexed by swap slot
+static size_t zswap_slot_cnt;
+static uint8_t *zswap_buffer;        // compressor output
+
+/* Statistics. */
+static unsigned long long hit_cnt;     // page-ins served from memory
+static unsigned long long miss_cnt;    // page-ins read from disk
+static unsigned long long store_cnt;   // pages compressed into memory
+static unsigned long long spill_cnt;   // pages sent to disk instead
+static unsigned long long stored_bytes;  // compressed size of those stored
+
+/* LZ compressor, in the style of LZ4.  A page is encoded as a series
+   of sequences, each a token byte holding a literal count in its high
+   nibble and a match length minus LZ_MIN_MATCH in its low nibble,
+   either of which continues in following bytes when it is 15; then
+   the literals; then a 2-byte little-endian offset back to the match.
+   The last sequence is literals only. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 10
+
+static uint16_t lz_table[1 << LZ_HASH_BITS];  // last position per hash
+
+static uint32_t
+lz_read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+static unsigned
+lz_hash (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the continuation bytes of length LEN to DST at *OP, within
+   CAP bytes.  Returns false if they don't fit. */
+static bool
+lz_put_length (uint8_t *dst, size_t *op, size_t cap, size_t len)
+{
+  for (; len >= 255; len -= 255) {
+    if (*op >= cap)
+      return false;
+    dst[(*op)++] = 255;
+  }
+  if (*op >= cap)
+    return false;
+  dst[(*op)++] = len;
+  return true;
+}
+
+/* Appends a sequence of LIT_LEN literals from LIT followed by a match
+   of MATCH_LEN bytes OFFSET back, or no match if MATCH_LEN is 0, to
+   DST at *OP, within CAP bytes.  Returns false if it doesn't fit. */
+static bool
+lz_emit (uint8_t *dst, size_t *op, size_t cap, const uint8_t *lit,
+         size_t lit_len, size_t offset, size_t match_len)
+{
+  size_t ml = match_len != 0 ? match_len - LZ_MIN_MATCH : 0;
+
+  if (*op >= cap)
+    return false;
+  dst[(*op)++] = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+  if (lit_len >= 15 && !lz_put_length (dst, op, cap, lit_len - 15))
+    return false;
+
+  if (*op + lit_len > cap)
+    return false;
+  memcpy (dst + *op, lit, lit_len);
+  *op += lit_len;
+  if (match_len == 0)
+    return true;
+
+  if (*op + 2 > cap)
+    return false;
+  dst[(*op)++] = offset & 0xff;
+  dst[(*op)++] = offset >> 8;
+  return ml < 15 || lz_put_length (dst, op, cap, ml - 15);
+}
+
+/* Compresses the page at SRC into DST.  Returns the compressed size,
+   or 0 if it would take more than CAP bytes. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap)
+{
+  size_t ip = 0, anchor = 0, op = 0;
+
+  memset (lz_table, 0, sizeof lz_table);
+  while (ip + LZ_MIN_MATCH <= PGSIZE) {
+    uint32_t v = lz_read32 (src + ip);
+    unsigned h = lz_hash (v);
+    size_t candidate = lz_table[h];
+    lz_table[h] = ip;
+
+    if (candidate >= ip || lz_read32 (src + candidate) != v) {
+      ip++;
+      continue;
+    }
+
+    size_t len = LZ_MIN_MATCH;
+    while (ip + len < PGSIZE && src[candidate + len] == src[ip + len])
+      len++;
+    if (!lz_emit (dst, &op, cap, src + anchor, ip - anchor, ip - candidate,
+                  len))
+      return 0;
+    ip += len;
+    anchor = ip;
+  }
+
+  if (!lz_emit (dst, &op, cap, src + anchor, PGSIZE - anchor, 0, 0))
+    return 0;
+  return op;
+}
+
+/* Reads a length continued past a nibble of 15 from SRC at *IP, adding
+   it to *LEN.  Returns false if SRC ends first. */
+static bool
+lz_get_length (const uint8_t *src, size_t *ip, size_t size, size_t *len)
+{
+  uint8_t b;
+  do {
+    if (*ip >= size)
+      return false;
+    b = src[(*ip)++];
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+/* Decompresses the SIZE bytes at SRC into the page at DST.  Returns
+   false if they don't decode to exactly one page. */
+static bool
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+  size_t ip = 0, op = 0;
+
+  while (ip < size) {
+    uint8_t token = src[ip++];
+
+    size_t lit_len = token >> 4;
+    if (lit_len == 15 && !lz_get_length (src, &ip, size, &lit_len))
+      return false;
+    if (ip + lit_len > size || op + lit_len > PGSIZE)
+      return false;
+    memcpy (dst + op, src + ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == size)
+      break;
+
+    if (ip + 2 > size)
+      return false;
+    size_t offset = src[ip] | src[ip + 1] << 8;
+    ip += 2;
+    size_t match_len = token & 15;
+    if (match_len == 15 && !lz_get_length (src, &ip, size, &match_len))
+      return false;
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > op || op + match_len > PGSIZE)
+      return false;
+    for (; match_len > 0; match_len--, op++)
+      dst[op] = dst[op - offset];  // may overlap, so byte by byte
+  }
+
+  return op == PGSIZE;
+}
+
+/* Sets up the compressed tier for a swap partition of SLOT_CNT
+   slots, reserving zswap_pages kernel pages for it. */
+void
+zswap_init (size_t slot_cnt)
+{
+  lock_init (&zswap_lock);
+
+  size_t chunk_cnt = zswap_pages * (PGSIZE / ZSWAP_CHUNK);
+  if (zswap_pages == 0 || slot_cnt == 0)
+    return;
+  if (chunk_cnt > UINT16_MAX) {
+    chunk_cnt = UINT16_MAX;
+    zswap_pages = chunk_cnt / (PGSIZE / ZSWAP_CHUNK);
+    chunk_cnt = zswap_pages * (PGSIZE / ZSWAP_CHUNK);
+  }
+
+  zswap_area = palloc_get_multiple (0, zswap_pages);
+  zswap_buffer = palloc_get_page (0);
+  zswap_used = bitmap_create (chunk_cnt);
+  zswap_slots = calloc (slot_cnt, sizeof *zswap_slots);
+  if (zswap_area == NULL || zswap_buffer == NULL || zswap_used == NULL ||
+      zswap_slots == NULL) {
+    printf ("swap cache: cannot reserve %zu pages, disabled\n", zswap_pages);
+    if (zswap_area != NULL)
+      palloc_free_multiple (zswap_area, zswap_pages);
+    if (zswap_buffer != NULL)
+      palloc_free_page (zswap_buffer);
+    if (zswap_used != NULL)
+      bitmap_destroy (zswap_used);
+    free (zswap_slots);
+    zswap_area = NULL;
+    zswap_slots = NULL;
+    return;
+  }
+  zswap_slot_cnt = slot_cnt;
+}
+
+/* Keeps a compressed copy of PAGE as the contents of swap slot SLOT,
+   which must not have one yet.  Returns false if PAGE has to go to
+   disk instead, because it doesn't compress well or the reserve is
+   full. */
+bool
+zswap_store (size_t slot, const void *page)
+{
+  if (zswap_slots == NULL)
+    return false;
+  ASSERT (slot < zswap_slot_cnt);
+
+  lock_acquire (&zswap_lock);
+  ASSERT (zswap_slots[slot].size == 0);
+
+  size_t chunk = BITMAP_ERROR;
+  size_t size = lz_compress (page, zswap_buffer, ZSWAP_MAX_SIZE);
+  if (size != 0)
+    chunk = bitmap_scan_and_flip (zswap_used, 0,
+                                  DIV_ROUND_UP (size, ZSWAP_CHUNK), false);
+
+  bool stored = chunk != BITMAP_ERROR;
+  if (stored) {
+    memcpy (zswap_area + chunk * ZSWAP_CHUNK, zswap_buffer, size);
+    zswap_slots[slot].chunk = chunk;
+    zswap_slots[slot].size = size;
+    store_cnt++;
+    stored_bytes += size;
+  } else {
+    spill_cnt++;
+  }
+
+  lock_release (&zswap_lock);
+  return stored;
+}
+
+/* Decompresses the contents of swap slot SLOT into PAGE.  The copy
+   stays until zswap_drop(), since the slot may still be shared.
+   Returns false if the slot's contents are on disk. */
+bool
+zswap_load (size_t slot, void *page)
+{
+  if (zswap_slots == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  struct zswap_slot *s = &zswap_slots[slot];
+  bool cached = s->size != 0;
+  if (cached) {
+    bool ok = lz_decompress (zswap_area + s->chunk * ZSWAP_CHUNK, s->size,
+                             page);
+    ASSERT (ok);
+    hit_cnt++;
+  } else {
+    miss_cnt++;
+  }
+  lock_release (&zswap_lock);
+
+  return cached;
+}
+
+/* Frees SLOT's compressed copy, if any.  Must be locked with
+   zswap_lock. */
+static void
+drop_slot (size_t slot)
+{
+  struct zswap_slot *s = &zswap_slots[slot];
+  if (s->size != 0) {
+    bitmap_set_multiple (zswap_used, s->chunk,
+                         DIV_ROUND_UP (s->size, ZSWAP_CHUNK), false);
+    s->size = 0;
+  }
+}
+
+/* Forgets the compressed copy of swap slot SLOT, if any, once the
+   slot has been freed. */
+void
+zswap_drop (size_t slot)
+{
+  if (zswap_slots == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  drop_slot (slot);
+  lock_release (&zswap_lock);
+}
+
+/* Like zswap_drop() for the CNT slots in SLOTS, taking the lock once. */
+void
+zswap_drop_multiple (const int *slots, size_t cnt)
+{
+  if (zswap_slots == NULL || cnt == 0)
+    return;
+
+  lock_acquire (&zswap_lock);
+  size_t i;
+  for (i = 0; i < cnt; i++)
+    drop_slot (slots[i]);
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap statistics. */
+void
+zswap_print_stats (void)
+{
+  if (zswap_slots == NULL)
+    return;
+  printf ("Swap cache: %llu hits, %llu misses, %llu pages stored, "
+          "%llu spilled to disk, compressed to %llu%%\n",
+          hit_cnt, miss_cnt, store_cnt, spill_cnt,
+          store_cnt != 0 ? stored_bytes * 100 / (store_cnt * PGSIZE) : 0);
+}
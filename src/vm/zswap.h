@@ -0,0 +1,18 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Kernel pages reserved for compressed swap, set by -swap-cache.
+   0 turns the compressed tier off. */
+extern size_t zswap_pages;
+
+void zswap_init (size_t slot_cnt);
+bool zswap_store (size_t slot, const void *page);
+bool zswap_load (size_t slot, void *page);
+void zswap_drop (size_t slot);
+void zswap_drop_multiple (const int *slots, size_t cnt);
+void zswap_print_stats (void);
+
+#endif